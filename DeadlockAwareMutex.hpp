@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include "SharedMutex.hpp"
+#include "LockRegistry.hpp"
+
+constexpr int DEADLOCK_POLL_TIME = 10; /* 10 ms, how often a waiter checks if it was chosen to fail */
+
+enum class LockStatus {
+	Acquired,
+	TimedOut,
+	Deadlock,   // Failed fast, the detector found this wait in a cycle
+};
+
+/*
+* - A LinuxSharedMutex that publishes its held and waited-for state to a
+*   LockRegistry, so cross-process deadlocks can be found with
+*   LockRegistry::Detect() or a DeadlockDetector
+* - If the detector fails this thread's wait, TryLock() returns false early
+*   and LastStatus() is LockStatus::Deadlock instead of LockStatus::TimedOut
+* - Tracking costs a few atomic stores into a per-thread slot per operation
+*/
+class DeadlockAwareSharedMutex : public LinuxSharedMutex
+{
+private:
+	LockRegistry& _registry;
+	uint64_t      _hash;
+	LockStatus    _lastStatus;
+
+public:
+	DeadlockAwareSharedMutex(const char* name, LockRegistry& registry = LockRegistry::Default())
+		: LinuxSharedMutex(name), _registry(registry), _lastStatus(LockStatus::TimedOut)
+	{
+		_hash = _registry.RegisterName(name);
+	}
+
+	virtual ~DeadlockAwareSharedMutex()
+	{
+		this->Release();
+	}
+
+	LockStatus LastStatus() const { return _lastStatus; }
+
+	bool TryLock(int timeout) override
+	{
+		_registry.BeginWait(_hash);
+
+		bool acquired = false;
+		_lastStatus = LockStatus::TimedOut;
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		do
+		{
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now()).count();
+			auto slice = (int) std::max<long>(0, std::min<long>(remaining, DEADLOCK_POLL_TIME));
+
+			if (LinuxSharedMutex::TryLock(slice))
+			{
+				acquired = true;
+				_lastStatus = LockStatus::Acquired;
+				break;
+			}
+			if (_registry.IsVictim())
+			{
+				_lastStatus = LockStatus::Deadlock;
+				break;
+			}
+		} while (std::chrono::steady_clock::now() < deadline);
+
+		_registry.EndWait(acquired, _hash);
+		return acquired;
+	}
+
+	void Unlock() override
+	{
+		if (this->IsLocked())
+			_registry.Released(_hash);
+		LinuxSharedMutex::Unlock();
+	}
+
+	void Release() override
+	{
+		if (this->IsLocked())
+			_registry.Released(_hash);
+		LinuxSharedMutex::Release();
+	}
+};
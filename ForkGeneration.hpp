@@ -0,0 +1,27 @@
+#pragma once
+
+#include <mutex>
+#include <pthread.h>
+
+/*
+* Counts the fork() calls that led to the current process.
+* - A forked child inherits the process-local caches of its parent (thread
+*   locals, mapped segments, claimed slots). Caches store the generation they
+*   were filled in and refill when it changed
+* - ForkGeneration() installs the fork handler on first use. Hot paths that
+*   already called it once may read ForkGenerationCounter() directly
+*/
+inline unsigned int& ForkGenerationCounter()
+{
+	static unsigned int generation = 0;
+	return generation;
+}
+
+inline unsigned int ForkGeneration()
+{
+	static std::once_flag installed;
+	std::call_once(installed, [] {
+		pthread_atfork(nullptr, nullptr, [] { ++ForkGenerationCounter(); });
+	});
+	return ForkGenerationCounter();
+}
@@ -0,0 +1,528 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "SharedRegion.hpp"
+#include "ForkGeneration.hpp"
+
+constexpr const char*  LOCK_REGISTRY_NAME       = "IPC_LOCK_REGISTRY";
+constexpr unsigned int LOCK_REGISTRY_SLOTS      = 256;  /* Threads that can take named locks at once */
+constexpr unsigned int LOCK_REGISTRY_HELD       = 16;   /* Named locks held at once by one thread */
+constexpr unsigned int LOCK_REGISTRY_NAMES      = 512;  /* Distinct lock names */
+constexpr unsigned int LOCK_REGISTRY_NAME_CHARS = 64;
+
+/*
+* One slot per thread taking named locks. Only the owning thread writes to
+* its slot (except victim, which the detector sets), so no lock is taken on
+* the lock/unlock path. Locks are identified by the hash of their name.
+*/
+struct lock_registry_slot {
+	std::atomic<pid_t>    pid;                        // Owning process, 0 when free
+	std::atomic<pid_t>    tid;                        // Owning thread
+	std::atomic<uint64_t> waiting;                    // Lock being waited for, 0 if none
+	std::atomic<uint32_t> waitSequence;               // Incremented every time a wait starts
+	std::atomic<uint32_t> victim;                     // waitSequence of the wait the detector chose to fail
+	std::atomic<long>     waitStart;                  // CLOCK_MONOTONIC milliseconds
+	std::atomic<uint64_t> held[LOCK_REGISTRY_HELD];   // Locks currently held, 0 for empty
+};
+
+struct lock_registry_name {
+	std::atomic<uint64_t> hash;                       // 0 when free, set after name is written
+	char                  name[LOCK_REGISTRY_NAME_CHARS];
+};
+
+/*
+* Registry segment mapped by every process using DeadlockAwareSharedMutex.
+* !! Fixed size slots only, no pointers !!
+*/
+struct lock_registry_layout {
+	shared_region_layout header;                      // header.mutex guards the name table
+	lock_registry_slot   slots[LOCK_REGISTRY_SLOTS];
+	lock_registry_name   names[LOCK_REGISTRY_NAMES];
+};
+
+struct DeadlockParticipant {
+	pid_t       pid;
+	pid_t       tid;
+	std::string waitingFor;  // Lock this thread is blocked on
+	std::string holding;     // Lock held by this thread that the previous participant waits for
+	bool        isVictim;    // Chosen to fail fast
+};
+
+typedef std::vector<DeadlockParticipant> DeadlockCycle;
+
+
+/*
+* - Process-wide wait-for registry for named locks, kept in shared memory
+* - Each thread publishes which named locks it holds and which one it waits
+*   for. Publishing is a handful of atomic stores into its own slot
+* - Detect() builds the wait-for graph from all slots and returns the cycles.
+*   A cycle is only reported if none of its threads moved on while it was
+*   being examined
+* - Slots of dead processes or threads are ignored and reused
+* - The registry segment is never deleted automatically, it is small and
+*   shared by all processes. Call Delete() to remove it
+*/
+class LockRegistry
+{
+private:
+	struct ThreadSlot {
+		unsigned long registryId;
+		unsigned int  forkGeneration;
+		int           slot;
+	};
+
+	const unsigned long           _id;
+	std::unique_ptr<SharedRegion> _share;
+
+public:
+	LockRegistry(const char *name = LOCK_REGISTRY_NAME)
+		: _id(NextId()), _share(new SharedRegion(name, sizeof(lock_registry_layout)))
+	{
+		_share->Create();
+		ForkGeneration(); // Install the fork handler
+	}
+
+	virtual ~LockRegistry()
+	{
+		// Free the slots of this process, other processes keep theirs
+		auto layout = Layout();
+		if (layout == nullptr)
+			return;
+		const pid_t pid = getpid();
+		for (auto &slot : layout->slots)
+		{
+			if (slot.pid.load(std::memory_order_relaxed) == pid)
+				ClearSlot(slot);
+		}
+	}
+
+	static LockRegistry& Default()
+	{
+		static LockRegistry registry;
+		return registry;
+	}
+
+	const std::string& Name() const { return _share->Name(); }
+	bool IsValid() const { return Layout() != nullptr; }
+
+	void Delete() { _share->Destroy(); }
+
+	static uint64_t Hash(const char *name)
+	{
+		// FNV-1a, stable across processes and builds
+		uint64_t hash = 14695981039346656037ull;
+		for (auto c = name; *c; ++c)
+		{
+			hash ^= (unsigned char) *c;
+			hash *= 1099511628211ull;
+		}
+		return hash == 0 ? 1 : hash;
+	}
+
+	// Record the name of a lock so reports can show it. Not on the locking path
+	uint64_t RegisterName(const char *name)
+	{
+		const uint64_t hash = Hash(name);
+		auto layout = Layout();
+		if (layout == nullptr)
+			return hash;
+
+		// Unnamed locks are reported by their hash
+		SharedRegionGuard guard(layout->header.mutex);
+		if (!guard.IsLocked())
+			return hash;
+		for (unsigned int i = 0; i < LOCK_REGISTRY_NAMES; ++i)
+		{
+			auto &entry = layout->names[(hash + i) % LOCK_REGISTRY_NAMES];
+			const auto entryHash = entry.hash.load(std::memory_order_acquire);
+			if (entryHash == hash)
+				break;
+			if (entryHash == 0)
+			{
+				strncpy(entry.name, name, LOCK_REGISTRY_NAME_CHARS - 1);
+				entry.name[LOCK_REGISTRY_NAME_CHARS - 1] = '\0';
+				entry.hash.store(hash, std::memory_order_release);
+				break;
+			}
+		}
+		return hash;
+	}
+
+	std::string LookupName(uint64_t hash) const
+	{
+		auto layout = Layout();
+		if (layout != nullptr)
+		{
+			for (unsigned int i = 0; i < LOCK_REGISTRY_NAMES; ++i)
+			{
+				auto &entry = layout->names[(hash + i) % LOCK_REGISTRY_NAMES];
+				const auto entryHash = entry.hash.load(std::memory_order_acquire);
+				if (entryHash == hash)
+					return std::string(entry.name);
+				if (entryHash == 0)
+					break;
+			}
+		}
+		return "#" + std::to_string(hash);
+	}
+
+	//------------------------------------------------------------------------------------------
+	// Called by the owning thread around lock operations
+
+	void BeginWait(uint64_t lock)
+	{
+		auto slot = ThisThreadSlot();
+		if (slot == nullptr)
+			return;
+		slot->waitStart.store(MonotonicMilliseconds(), std::memory_order_relaxed);
+		if (slot->waitSequence.fetch_add(1, std::memory_order_relaxed) == UINT32_MAX)
+			slot->waitSequence.fetch_add(1, std::memory_order_relaxed); // 0 is no victim, never a wait
+		slot->waiting.store(lock, std::memory_order_release);
+	}
+
+	void EndWait(bool acquired, uint64_t lock)
+	{
+		auto slot = ThisThreadSlot();
+		if (slot == nullptr)
+			return;
+		if (acquired)
+			AddHeld(*slot, lock);
+		slot->waiting.store(0, std::memory_order_release);
+	}
+
+	void Released(uint64_t lock)
+	{
+		auto slot = ThisThreadSlot();
+		if (slot == nullptr)
+			return;
+		for (auto &held : slot->held)
+		{
+			if (held.load(std::memory_order_relaxed) == lock)
+			{
+				held.store(0, std::memory_order_release);
+				break;
+			}
+		}
+	}
+
+	// Whether the detector chose this thread's current wait to fail. A victim
+	// stored for an earlier wait does not match the current waitSequence
+	bool IsVictim() const
+	{
+		auto slot = ThisThreadSlot();
+		if (slot == nullptr)
+			return false;
+		const uint32_t victim = slot->victim.load(std::memory_order_acquire);
+		return victim != 0 && victim == slot->waitSequence.load(std::memory_order_relaxed);
+	}
+
+	//------------------------------------------------------------------------------------------
+	// Detection, can run from any process
+
+	std::vector<DeadlockCycle> Detect(bool failVictim = false)
+	{
+		std::vector<DeadlockCycle> cycles;
+		auto layout = Layout();
+		if (layout == nullptr)
+			return cycles;
+
+		// Snapshot the live slots
+		struct Node {
+			int                   slot;
+			pid_t                 pid;
+			pid_t                 tid;
+			uint64_t              waiting;
+			uint32_t              waitSequence;
+			long                  waitStart;
+			std::vector<uint64_t> held;
+		};
+		std::vector<Node> nodes;
+		std::map<uint64_t, std::vector<size_t>> holders;
+
+		for (int i = 0; i < (int)LOCK_REGISTRY_SLOTS; ++i)
+		{
+			auto &slot = layout->slots[i];
+			Node node;
+			node.slot = i;
+			node.pid = slot.pid.load(std::memory_order_acquire);
+			if (node.pid == 0)
+				continue;
+			node.tid = slot.tid.load(std::memory_order_relaxed);
+			node.waitSequence = slot.waitSequence.load(std::memory_order_relaxed);
+			node.waiting = slot.waiting.load(std::memory_order_acquire);
+			node.waitStart = slot.waitStart.load(std::memory_order_relaxed);
+			for (auto &held : slot.held)
+			{
+				auto lock = held.load(std::memory_order_acquire);
+				if (lock != 0)
+					node.held.push_back(lock);
+			}
+			if (!IsThreadAlive(node.pid, node.tid))
+				continue;
+
+			for (auto lock : node.held)
+				holders[lock].push_back(nodes.size());
+			nodes.push_back(std::move(node));
+		}
+
+		// Depth first search over waiter -> holder edges
+		enum { Unvisited, OnStack, Done };
+		std::vector<int> state(nodes.size(), Unvisited);
+		std::vector<size_t> stack;
+
+		std::function<void(size_t)> visit = [&](size_t index) {
+			state[index] = OnStack;
+			stack.push_back(index);
+
+			const auto &node = nodes[index];
+			if (node.waiting != 0)
+			{
+				auto found = holders.find(node.waiting);
+				if (found != holders.end())
+				{
+					for (auto next : found->second)
+					{
+						if (next == index)
+							continue;
+						if (state[next] == OnStack)
+						{
+							std::vector<size_t> members;
+							auto start = std::find(stack.begin(), stack.end(), next);
+							members.assign(start, stack.end());
+							ReportCycle(*layout, nodes, members, failVictim, cycles);
+						}
+						else if (state[next] == Unvisited)
+							visit(next);
+					}
+				}
+			}
+
+			stack.pop_back();
+			state[index] = Done;
+		};
+
+		for (size_t i = 0; i < nodes.size(); ++i)
+		{
+			if (state[i] == Unvisited)
+				visit(i);
+		}
+		return cycles;
+	}
+
+private:
+	template <typename NodeList>
+	void ReportCycle(
+		lock_registry_layout &layout,
+		const NodeList &nodes,
+		const std::vector<size_t> &members,
+		bool failVictim,
+		std::vector<DeadlockCycle> &cycles)
+	{
+		// The graph is read without locking, confirm nobody moved on meanwhile
+		for (auto index : members)
+		{
+			const auto &node = nodes[index];
+			const auto &slot = layout.slots[node.slot];
+			if (slot.pid.load(std::memory_order_acquire) != node.pid ||
+				slot.waitSequence.load(std::memory_order_acquire) != node.waitSequence ||
+				slot.waiting.load(std::memory_order_acquire) != node.waiting)
+				return;
+		}
+
+		// The youngest waiter is the cheapest to fail
+		size_t victim = members.front();
+		for (auto index : members)
+		{
+			if (nodes[index].waitStart > nodes[victim].waitStart)
+				victim = index;
+		}
+
+		DeadlockCycle cycle;
+		for (size_t i = 0; i < members.size(); ++i)
+		{
+			const auto &node = nodes[members[i]];
+			const auto &previous = nodes[members[(i + members.size() - 1) % members.size()]];
+
+			DeadlockParticipant participant;
+			participant.pid = node.pid;
+			participant.tid = node.tid;
+			participant.waitingFor = LookupName(node.waiting);
+			participant.holding = LookupName(previous.waiting);
+			participant.isVictim = failVictim && members[i] == victim;
+			cycle.push_back(participant);
+		}
+
+		// Names the confirmed wait, so it cannot fail a later one the thread started meanwhile
+		if (failVictim)
+			layout.slots[nodes[victim].slot].victim.store(nodes[victim].waitSequence, std::memory_order_release);
+
+		cycles.push_back(std::move(cycle));
+	}
+
+	lock_registry_layout* Layout() const
+	{
+		return _share->GetAs<lock_registry_layout>();
+	}
+
+	lock_registry_slot* ThisThreadSlot() const
+	{
+		constexpr unsigned int CACHE_SIZE = 4;
+		thread_local ThreadSlot cache[CACHE_SIZE] = {};
+		thread_local unsigned int nextEntry = 0;
+
+		auto layout = Layout();
+		if (layout == nullptr)
+			return nullptr;
+
+		const auto generation = ForkGeneration();
+		for (auto &entry : cache)
+		{
+			if (entry.registryId == _id && entry.forkGeneration == generation)
+				return entry.slot < 0 ? nullptr : &layout->slots[entry.slot];
+		}
+
+		auto &entry = cache[nextEntry++ % CACHE_SIZE];
+		entry.registryId = _id;
+		entry.forkGeneration = generation;
+		entry.slot = ClaimSlot(*layout);
+		return entry.slot < 0 ? nullptr : &layout->slots[entry.slot];
+	}
+
+	static int ClaimSlot(lock_registry_layout &layout)
+	{
+		const pid_t pid = getpid();
+		const pid_t tid = (pid_t) syscall(SYS_gettid);
+
+		for (int i = 0; i < (int)LOCK_REGISTRY_SLOTS; ++i)
+		{
+			auto &slot = layout.slots[i];
+			pid_t owner = slot.pid.load(std::memory_order_acquire);
+			if (owner != 0 && IsThreadAlive(owner, slot.tid.load(std::memory_order_relaxed)))
+				continue;
+			if (slot.pid.compare_exchange_strong(owner, pid, std::memory_order_acq_rel))
+			{
+				slot.tid.store(tid, std::memory_order_relaxed);
+				slot.waiting.store(0, std::memory_order_relaxed);
+				slot.victim.store(0, std::memory_order_relaxed);
+				for (auto &held : slot.held)
+					held.store(0, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				return i;
+			}
+		}
+		return -1; // Registry full, this thread is not tracked
+	}
+
+	static void ClearSlot(lock_registry_slot &slot)
+	{
+		slot.waiting.store(0, std::memory_order_relaxed);
+		for (auto &held : slot.held)
+			held.store(0, std::memory_order_relaxed);
+		slot.pid.store(0, std::memory_order_release);
+	}
+
+	static void AddHeld(lock_registry_slot &slot, uint64_t lock)
+	{
+		for (auto &held : slot.held)
+		{
+			if (held.load(std::memory_order_relaxed) == 0)
+			{
+				held.store(lock, std::memory_order_release);
+				return;
+			}
+		}
+	}
+
+	static bool IsThreadAlive(pid_t pid, pid_t tid)
+	{
+		if (syscall(SYS_tgkill, pid, tid, 0) == 0)
+			return true;
+		return errno != ESRCH;
+	}
+
+	static long MonotonicMilliseconds()
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+		return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	}
+
+	static unsigned long NextId()
+	{
+		static std::atomic<unsigned long> id(1);
+		return id.fetch_add(1);
+	}
+};
+
+
+/*
+* Runs LockRegistry::Detect() periodically on a background thread.
+* Found cycles are passed to the callback.
+*/
+class DeadlockDetector
+{
+private:
+	LockRegistry&                                  _registry;
+	std::function<void(const DeadlockCycle&)>      _callback;
+	std::thread                                    _thread;
+	std::mutex                                     _mutex;
+	std::condition_variable                        _stopped;
+	std::atomic<bool>                              _running;
+
+public:
+	DeadlockDetector(LockRegistry &registry, std::function<void(const DeadlockCycle&)> callback)
+		: _registry(registry), _callback(std::move(callback)), _running(false) {}
+
+	virtual ~DeadlockDetector() { this->Stop(); }
+
+	bool IsRunning() const { return _running; }
+
+	void Start(int interval, bool failVictim)
+	{
+		this->Stop();
+		_running = true;
+		_thread = std::thread([this, interval, failVictim] {
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (_running)
+			{
+				lock.unlock();
+				for (auto &cycle : _registry.Detect(failVictim))
+				{
+					if (_callback)
+						_callback(cycle);
+				}
+				lock.lock();
+				_stopped.wait_for(lock, std::chrono::milliseconds(interval), [this] { return !_running; });
+			}
+		});
+	}
+
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_running = false;
+		}
+		_stopped.notify_all();
+		if (_thread.joinable())
+			_thread.join();
+	}
+};
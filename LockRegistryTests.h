@@ -0,0 +1,203 @@
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "LockRegistry.hpp"
+#include "DeadlockAwareMutex.hpp"
+#include "TestHelpers.h"
+
+constexpr TestName REGISTRY_NAME_1 = "LOCK_REGISTRY_1";
+constexpr TestName LOCK_NAME_A     = "LOCK_A";
+constexpr TestName LOCK_NAME_B     = "LOCK_B";
+
+/*
+* Runs a thread that publishes registry state and then parks until the test ends,
+* so its slot stays alive while the detector looks at it
+*/
+class RegistryThread
+{
+private:
+	std::thread       _thread;
+	std::atomic<bool> _ready;
+	std::atomic<bool> _done;
+
+public:
+	RegistryThread(LockRegistry &registry, uint64_t holds, uint64_t waitsFor) : _ready(false), _done(false)
+	{
+		_thread = std::thread([this, &registry, holds, waitsFor] {
+			registry.BeginWait(holds);
+			registry.EndWait(true, holds);
+			if (waitsFor != 0)
+				registry.BeginWait(waitsFor);
+			_ready = true;
+			while (!_done)
+				SleepFor(1);
+			registry.EndWait(false, waitsFor);
+			registry.Released(holds);
+		});
+		while (!_ready)
+			SleepFor(1);
+	}
+
+	virtual ~RegistryThread()
+	{
+		_done = true;
+		_thread.join();
+	}
+};
+
+//====================================================================================================
+//====================================================================================================
+
+void Test_LockRegistry_RegisterName_LookupReturnsName()
+{
+	logtest(__func__);
+
+	LockRegistry registry(REGISTRY_NAME_1);
+	auto hash = registry.RegisterName(LOCK_NAME_A);
+	auto name = registry.LookupName(hash);
+	auto hashAgain = registry.RegisterName(LOCK_NAME_A);
+	registry.Delete();
+
+	compare<std::string>(name, std::string(LOCK_NAME_A), "Registered name not found");
+	compare<uint64_t>(hashAgain, hash, "Lock name hash is not stable");
+}
+
+void Test_LockRegistry_WaitWithoutCycle_DetectsNothing()
+{
+	logtest(__func__);
+
+	LockRegistry registry(REGISTRY_NAME_1);
+	auto lockA = registry.RegisterName(LOCK_NAME_A);
+	auto lockB = registry.RegisterName(LOCK_NAME_B);
+	size_t cycleCount = 0;
+	{
+		RegistryThread holder(registry, lockA, 0);
+		RegistryThread waiter(registry, lockB, lockA);
+		cycleCount = registry.Detect().size();
+	}
+	registry.Delete();
+
+	compare<size_t>(cycleCount, 0, "No deadlock should be reported");
+}
+
+void Test_LockRegistry_TwoThreadCycle_Detected()
+{
+	logtest(__func__);
+
+	LockRegistry registry(REGISTRY_NAME_1);
+	auto lockA = registry.RegisterName(LOCK_NAME_A);
+	auto lockB = registry.RegisterName(LOCK_NAME_B);
+	std::vector<DeadlockCycle> cycles;
+	{
+		RegistryThread first(registry, lockA, lockB);
+		RegistryThread second(registry, lockB, lockA);
+		cycles = registry.Detect();
+	}
+	registry.Delete();
+
+	compare<size_t>(cycles.size(), 1, "Deadlock should be reported once");
+	compare<size_t>(cycles[0].size(), 2, "Deadlock should have two participants");
+	for (auto &participant : cycles[0])
+	{
+		compare<pid_t>(participant.pid, getpid(), "Participant pid incorrect");
+		assert(participant.waitingFor != participant.holding, "Participant waits for a lock it holds");
+		assert(participant.isVictim == false, "No victim should be chosen");
+	}
+}
+
+void Test_LockRegistry_FailVictim_MarksOneWaiter()
+{
+	logtest(__func__);
+
+	LockRegistry registry(REGISTRY_NAME_1);
+	auto lockA = registry.RegisterName(LOCK_NAME_A);
+	auto lockB = registry.RegisterName(LOCK_NAME_B);
+	std::vector<DeadlockCycle> cycles;
+	{
+		RegistryThread first(registry, lockA, lockB);
+		RegistryThread second(registry, lockB, lockA);
+		cycles = registry.Detect(true);
+	}
+	registry.Delete();
+
+	compare<size_t>(cycles.size(), 1, "Deadlock should be reported once");
+	int victims = 0;
+	for (auto &participant : cycles[0])
+		victims += participant.isVictim ? 1 : 0;
+	compare<int>(victims, 1, "Exactly one victim should be chosen");
+}
+
+void Test_DeadlockAwareMutexes_TwoProcessCycle_VictimFailsFast()
+{
+	logtest(__func__);
+
+	LockRegistry registry(REGISTRY_NAME_1);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		DeadlockAwareSharedMutex mutexA(LOCK_NAME_A, registry);
+		DeadlockAwareSharedMutex mutexB(LOCK_NAME_B, registry);
+		mutexB.TryLock(0);
+		barrier.Arrive(); // Both hold their first lock
+		mutexA.TryLock(CHILD_SLEEP_TIME);
+		mutexA.Release();
+		mutexB.Release();
+		ExitChild();
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		DeadlockAwareSharedMutex mutexA(LOCK_NAME_A, registry);
+		DeadlockAwareSharedMutex mutexB(LOCK_NAME_B, registry);
+		mutexA.TryLock(0);
+		barrier.Arrive();
+
+		std::atomic<int> found(0);
+		DeadlockDetector detector(registry, [&found](const DeadlockCycle&) { ++found; });
+		detector.Start(DEADLOCK_POLL_TIME, true);
+
+		auto start = std::chrono::steady_clock::now();
+		auto locked = mutexB.TryLock(CHILD_SLEEP_TIME);
+		auto status = mutexB.LastStatus();
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+		detector.Stop();
+		mutexB.Release();
+		mutexA.Release();
+
+		StopChild(childPid);
+		registry.Delete();
+
+		assert(found > 0, "Deadlock was not detected");
+		assert(elapsed < WAIT_TIME_2 * 4, "Deadlock victim did not fail fast");
+		assert(locked || status == LockStatus::Deadlock, "Parent should either be the victim or acquire the lock");
+	}
+}
+
+//====================================================================================================
+//====================================================================================================
+
+static std::vector<TestCase> GetLockRegistryTests()
+{
+	return std::vector<TestCase> {
+		TEST_CASE(Test_LockRegistry_RegisterName_LookupReturnsName),
+		TEST_CASE(Test_LockRegistry_WaitWithoutCycle_DetectsNothing),
+		TEST_CASE(Test_LockRegistry_TwoThreadCycle_Detected),
+		TEST_CASE(Test_LockRegistry_FailVictim_MarksOneWaiter),
+		TEST_CASE(Test_DeadlockAwareMutexes_TwoProcessCycle_VictimFailsFast),
+	};
+}
@@ -0,0 +1,543 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "SharedRegion.hpp"
+#include "ForkGeneration.hpp"
+#include "LockRegistry.hpp"
+
+/*
+* Lock event tracing.
+* - Built only with IPC_MUTEX_TRACE defined (cmake -DIPC_MUTEX_TRACE=ON).
+*   Without it TracedSharedMutex is LinuxSharedMutex and nothing is recorded
+* - Every process writes to its own shared segment, /dev/shm/IPC_TRACE.<pid>,
+*   with one single-writer ring buffer per thread. Recording an event is a
+*   CLOCK_MONOTONIC read and a few stores, no lock and no system call
+* - Segments outlive their process so IpcMutexTraceExport can merge all of
+*   them into one Chrome/Perfetto JSON timeline
+* - With <sys/sdt.h> available, USDT probes ipcmutex:acquire_start,
+*   ipcmutex:acquired, ipcmutex:timeout and ipcmutex:release are also placed,
+*   for perf and bpftrace
+*/
+
+constexpr const char*  LOCK_TRACE_PREFIX     = "IPC_TRACE";
+constexpr unsigned int LOCK_TRACE_THREADS    = 32;    /* Traced threads per process */
+constexpr unsigned int LOCK_TRACE_EVENTS     = 8192;  /* Events kept per thread, power of two */
+constexpr unsigned int LOCK_TRACE_NAMES      = 256;   /* Lock names per process */
+constexpr unsigned int LOCK_TRACE_NAME_CHARS = 64;
+constexpr pid_t        LOCK_TRACE_CLAIMING   = -1;    /* tid of a buffer being reset for its new thread */
+
+static_assert((LOCK_TRACE_EVENTS & (LOCK_TRACE_EVENTS - 1)) == 0, "LOCK_TRACE_EVENTS must be a power of two");
+
+enum class LockEvent : uint32_t {
+	AcquireStart = 1,
+	Acquired     = 2,
+	Timeout      = 3,
+	Release      = 4,
+};
+
+struct lock_trace_event {
+	uint64_t timestamp;   // CLOCK_MONOTONIC nanoseconds, comparable across processes
+	uint64_t lock;        // Hash of the mutex name
+	uint32_t type;        // LockEvent
+	uint32_t reserved;
+};
+
+struct lock_trace_thread {
+	std::atomic<pid_t>    tid;                          // 0 when free, LOCK_TRACE_CLAIMING while reset
+	std::atomic<uint64_t> head;                         // Events ever written
+	lock_trace_event      events[LOCK_TRACE_EVENTS];    // Ring, indexed by head % LOCK_TRACE_EVENTS
+};
+
+struct lock_trace_name {
+	std::atomic<uint64_t> hash;                         // 0 when free, set after name is written
+	char                  name[LOCK_TRACE_NAME_CHARS];
+};
+
+/*
+* One segment per process.
+* !! Fixed size only, no pointers !!
+*/
+struct lock_trace_layout {
+	shared_region_layout  header;
+	std::atomic<pid_t>    pid;
+	std::atomic<uint64_t> dropped;                      // Events lost because all thread buffers were taken
+	lock_trace_name       names[LOCK_TRACE_NAMES];
+	lock_trace_thread     threads[LOCK_TRACE_THREADS];
+};
+
+struct LockTraceRecord {
+	pid_t       pid;
+	pid_t       tid;
+	uint64_t    timestamp;
+	LockEvent   type;
+	std::string lock;
+};
+
+/*
+* Reads every trace segment with the given prefix, oldest event first.
+* Events overwritten while reading are skipped
+*/
+inline std::vector<LockTraceRecord> ReadLockTraces(const std::string &prefix = LOCK_TRACE_PREFIX, std::vector<std::string> *segments = nullptr)
+{
+	std::vector<LockTraceRecord> records;
+	auto directory = opendir("/dev/shm");
+	if (directory == nullptr)
+		return records;
+
+	const std::string start = prefix + ".";
+	std::vector<std::string> names;
+	while (auto entry = readdir(directory))
+	{
+		const std::string name = entry->d_name;
+		if (name.compare(0, start.size(), start) == 0)
+			names.push_back(name);
+	}
+	closedir(directory);
+
+	for (auto &name : names)
+	{
+		SharedRegion region(name.c_str(), sizeof(lock_trace_layout));
+		if (!region.Create())
+			continue;
+		if (segments != nullptr)
+			segments->push_back(name);
+
+		auto layout = region.GetAs<lock_trace_layout>();
+		const pid_t pid = layout->pid.load(std::memory_order_acquire);
+
+		auto lookup = [layout](uint64_t hash) {
+			for (unsigned int i = 0; i < LOCK_TRACE_NAMES; ++i)
+			{
+				auto &entry = layout->names[(hash + i) % LOCK_TRACE_NAMES];
+				const auto entryHash = entry.hash.load(std::memory_order_acquire);
+				if (entryHash == hash)
+					return std::string(entry.name, strnlen(entry.name, LOCK_TRACE_NAME_CHARS));
+				if (entryHash == 0)
+					break;
+			}
+			return "#" + std::to_string(hash);
+		};
+
+		for (auto &thread : layout->threads)
+		{
+			const pid_t tid = thread.tid.load(std::memory_order_acquire);
+			if (tid == 0 || tid == LOCK_TRACE_CLAIMING)
+				continue;
+
+			const uint64_t head = thread.head.load(std::memory_order_acquire);
+			const uint64_t first = head > LOCK_TRACE_EVENTS ? head - LOCK_TRACE_EVENTS : 0;
+			std::vector<lock_trace_event> events;
+			for (uint64_t i = first; i < head; ++i)
+				events.push_back(thread.events[i % LOCK_TRACE_EVENTS]);
+
+			// The writer may have lapped us while copying, and may be overwriting the slot of event headAfter
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const uint64_t headAfter = thread.head.load(std::memory_order_acquire);
+			if (thread.tid.load(std::memory_order_relaxed) != tid)
+				continue; // Reused by a new thread meanwhile, the copy may mix both
+			const uint64_t valid = headAfter + 1 > LOCK_TRACE_EVENTS ? headAfter + 1 - LOCK_TRACE_EVENTS : 0;
+			for (uint64_t i = std::max(first, valid); i < head; ++i)
+			{
+				const auto &event = events[i - first];
+				records.push_back({ pid, tid, event.timestamp, (LockEvent) event.type, lookup(event.lock) });
+			}
+		}
+	}
+
+	std::stable_sort(records.begin(), records.end(), [](const LockTraceRecord &a, const LockTraceRecord &b) {
+		return a.timestamp < b.timestamp;
+	});
+	return records;
+}
+
+inline void DeleteLockTraces(const std::vector<std::string> &segments)
+{
+	for (auto &name : segments)
+		shm_unlink(name.c_str());
+}
+
+inline std::string LockTraceEscape(const std::string &text)
+{
+	std::string escaped;
+	for (auto c : text)
+	{
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		if ((unsigned char) c < 0x20)
+			continue;
+		escaped += c;
+	}
+	return escaped;
+}
+
+inline std::string LockTraceMicroseconds(uint64_t nanoseconds)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.3f", nanoseconds / 1000.0);
+	return buffer;
+}
+
+/*
+* Turns records into a Chrome/Perfetto JSON timeline, see trace_export.cpp
+* - Waiting for a lock becomes a "wait <name>" slice, from acquire-start to
+*   acquired or timeout. A timeout is also marked with an instant event
+* - Holding a lock becomes a "hold <name>" slice, from acquired to release
+*/
+inline std::string ExportLockTraces(const std::vector<LockTraceRecord> &records)
+{
+	typedef std::tuple<pid_t, pid_t, std::string> Key;
+	std::map<Key, uint64_t> waitStart;
+	std::map<Key, uint64_t> holdStart;
+	std::set<pid_t> pids;
+	std::vector<std::string> events;
+
+	auto slice = [&events](const std::string &name, const char *category, const LockTraceRecord &record, uint64_t start, const char *result) {
+		std::ostringstream event;
+		event
+			<< "{\"name\":\"" << LockTraceEscape(name) << "\",\"cat\":\"" << category << "\",\"ph\":\"X\""
+			<< ",\"pid\":" << record.pid << ",\"tid\":" << record.tid
+			<< ",\"ts\":" << LockTraceMicroseconds(start) << ",\"dur\":" << LockTraceMicroseconds(record.timestamp - start);
+		if (result != nullptr)
+			event << ",\"args\":{\"result\":\"" << result << "\"}";
+		event << "}";
+		events.push_back(event.str());
+	};
+
+	for (auto &record : records)
+	{
+		pids.insert(record.pid);
+		const Key key(record.pid, record.tid, record.lock);
+
+		switch (record.type)
+		{
+		case LockEvent::AcquireStart:
+			waitStart[key] = record.timestamp;
+			break;
+
+		case LockEvent::Acquired:
+		case LockEvent::Timeout:
+		{
+			const bool acquired = record.type == LockEvent::Acquired;
+			auto found = waitStart.find(key);
+			if (found != waitStart.end())
+			{
+				slice("wait " + record.lock, "wait", record, found->second, acquired ? "acquired" : "timeout");
+				waitStart.erase(found);
+			}
+			if (acquired)
+				holdStart[key] = record.timestamp;
+			else
+			{
+				std::ostringstream event;
+				event
+					<< "{\"name\":\"timeout " << LockTraceEscape(record.lock) << "\",\"cat\":\"timeout\",\"ph\":\"i\",\"s\":\"t\""
+					<< ",\"pid\":" << record.pid << ",\"tid\":" << record.tid
+					<< ",\"ts\":" << LockTraceMicroseconds(record.timestamp) << "}";
+				events.push_back(event.str());
+			}
+			break;
+		}
+
+		case LockEvent::Release:
+		{
+			auto found = holdStart.find(key);
+			if (found != holdStart.end())
+			{
+				slice("hold " + record.lock, "hold", record, found->second, nullptr);
+				holdStart.erase(found);
+			}
+			break;
+		}
+		}
+	}
+
+	for (auto pid : pids)
+	{
+		std::ostringstream event;
+		event << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":\"pid " << pid << "\"}}";
+		events.push_back(event.str());
+	}
+
+	std::ostringstream json;
+	json << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << std::endl;
+	for (size_t i = 0; i < events.size(); ++i)
+		json << events[i] << (i + 1 < events.size() ? "," : "") << std::endl;
+	json << "]}" << std::endl;
+	return json.str();
+}
+
+#ifdef IPC_MUTEX_TRACE
+
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LOCK_TRACE_PROBE(event, name, hash) DTRACE_PROBE2(ipcmutex, event, name, hash)
+#else
+#define LOCK_TRACE_PROBE(event, name, hash) ((void)0)
+#endif
+
+#include "SharedMutex.hpp"
+
+/*
+* - Owns the trace segment of this process, created on the first event
+* - Each thread claims one ring buffer in it and keeps writing only there.
+*   When all buffers are taken, buffers of exited threads are reused;
+*   otherwise the event is counted as dropped
+* - A forked child writes to a new segment named after its own pid
+*/
+class LockTracer
+{
+private:
+	struct ThreadBuffer {
+		unsigned long      tracerId;
+		unsigned int       forkGeneration;
+		lock_trace_layout* layout;
+		lock_trace_thread* buffer;    // nullptr when all buffers were taken
+	};
+
+	const std::string             _prefix;
+	const unsigned long           _id;
+	std::mutex                    _mutex;
+	std::unique_ptr<SharedRegion> _share;
+	unsigned int                  _shareGeneration;
+
+public:
+	LockTracer(const char *prefix = LOCK_TRACE_PREFIX) : _prefix(prefix), _id(NextId()), _shareGeneration(0)
+	{
+		ForkGeneration(); // Install the fork handler
+	}
+
+	virtual ~LockTracer() {}
+
+	static LockTracer& Default()
+	{
+		static LockTracer tracer;
+		return tracer;
+	}
+
+	const std::string& Prefix() const { return _prefix; }
+
+	// Record the name of a lock so the exporter can show it. Not on the locking path
+	uint64_t RegisterName(const char *name)
+	{
+		const uint64_t hash = LockRegistry::Hash(name);
+		auto layout = Layout();
+		if (layout == nullptr)
+			return hash;
+
+		std::lock_guard<std::mutex> guard(_mutex);
+		for (unsigned int i = 0; i < LOCK_TRACE_NAMES; ++i)
+		{
+			auto &entry = layout->names[(hash + i) % LOCK_TRACE_NAMES];
+			const auto entryHash = entry.hash.load(std::memory_order_acquire);
+			if (entryHash == hash)
+				break;
+			if (entryHash == 0)
+			{
+				strncpy(entry.name, name, LOCK_TRACE_NAME_CHARS - 1);
+				entry.name[LOCK_TRACE_NAME_CHARS - 1] = '\0';
+				entry.hash.store(hash, std::memory_order_release);
+				break;
+			}
+		}
+		return hash;
+	}
+
+	void Record(LockEvent type, uint64_t lock)
+	{
+		auto &entry = ThisThreadBuffer();
+		auto thread = entry.buffer;
+		if (thread == nullptr)
+		{
+			if (entry.layout != nullptr)
+				entry.layout->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		// Single writer, only head needs to be published
+		const uint64_t head = thread->head.load(std::memory_order_relaxed);
+		auto &event = thread->events[head & (LOCK_TRACE_EVENTS - 1)];
+		event.timestamp = (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+		event.lock = lock;
+		event.type = (uint32_t) type;
+		thread->head.store(head + 1, std::memory_order_release);
+	}
+
+private:
+	// Only on first use of a buffer or name, so the lock is not on the recording path
+	lock_trace_layout* Layout()
+	{
+		const auto generation = ForkGenerationCounter();
+		std::lock_guard<std::mutex> guard(_mutex);
+		if (!_share || _shareGeneration != generation)
+		{
+			// A forked child keeps the parent's segment mapped but writes its own
+			if (_share)
+				_share->Unmap();
+
+			const std::string name = _prefix + "." + std::to_string(getpid());
+			_share.reset(new SharedRegion(name.c_str(), sizeof(lock_trace_layout)));
+			if (_share->Create())
+				_share->GetAs<lock_trace_layout>()->pid.store(getpid(), std::memory_order_release);
+			_shareGeneration = generation;
+		}
+		return _share->GetAs<lock_trace_layout>();
+	}
+
+	ThreadBuffer& ThisThreadBuffer()
+	{
+		constexpr unsigned int CACHE_SIZE = 4;
+		thread_local ThreadBuffer cache[CACHE_SIZE] = {};
+		thread_local unsigned int nextEntry = 0;
+
+		// The fork handler was installed by the constructor
+		const auto generation = ForkGenerationCounter();
+		for (auto &entry : cache)
+		{
+			if (entry.tracerId == _id && entry.forkGeneration == generation)
+				return entry;
+		}
+
+		auto &entry = cache[nextEntry++ % CACHE_SIZE];
+		entry.tracerId = _id;
+		entry.forkGeneration = generation;
+		entry.layout = Layout();
+		entry.buffer = ClaimBuffer(entry.layout);
+		return entry;
+	}
+
+	static lock_trace_thread* ClaimBuffer(lock_trace_layout *layout)
+	{
+		if (layout == nullptr)
+			return nullptr;
+
+		const pid_t pid = getpid();
+		const pid_t tid = (pid_t) syscall(SYS_gettid);
+
+		// Prefer a free buffer, so traces of exited threads are kept as long as possible
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (auto &thread : layout->threads)
+			{
+				pid_t owner = thread.tid.load(std::memory_order_acquire);
+				if (owner != 0 && (pass == 0 || owner == LOCK_TRACE_CLAIMING || IsThreadAlive(pid, owner)))
+					continue;
+				if (!thread.tid.compare_exchange_strong(owner, LOCK_TRACE_CLAIMING, std::memory_order_acq_rel))
+					continue;
+
+				// Drop the events of the exited thread before readers see the new tid
+				thread.head.store(0, std::memory_order_relaxed);
+				thread.tid.store(tid, std::memory_order_release);
+				return &thread;
+			}
+		}
+
+		return nullptr;
+	}
+
+	static bool IsThreadAlive(pid_t pid, pid_t tid)
+	{
+		if (syscall(SYS_tgkill, pid, tid, 0) == 0)
+			return true;
+		return errno != ESRCH;
+	}
+
+	static unsigned long NextId()
+	{
+		static std::atomic<unsigned long> id(1);
+		return id.fetch_add(1);
+	}
+};
+
+
+/*
+* LinuxSharedMutex that records acquire-start, acquired, timeout and release
+* events, and fires the matching USDT probes
+*/
+class TracedSharedMutex : public LinuxSharedMutex
+{
+private:
+	const std::string _traceName;
+	LockTracer&       _tracer;
+	uint64_t          _hash;
+
+public:
+	TracedSharedMutex(const char* name, LockTracer& tracer = LockTracer::Default())
+		: LinuxSharedMutex(name), _traceName(name), _tracer(tracer)
+	{
+		_hash = _tracer.RegisterName(name);
+	}
+
+	virtual ~TracedSharedMutex()
+	{
+		this->Release();
+	}
+
+	bool TryLock(int timeout) override
+	{
+		LOCK_TRACE_PROBE(acquire_start, _traceName.c_str(), _hash);
+		_tracer.Record(LockEvent::AcquireStart, _hash);
+
+		const bool acquired = LinuxSharedMutex::TryLock(timeout);
+		if (acquired)
+		{
+			LOCK_TRACE_PROBE(acquired, _traceName.c_str(), _hash);
+			_tracer.Record(LockEvent::Acquired, _hash);
+		}
+		else
+		{
+			LOCK_TRACE_PROBE(timeout, _traceName.c_str(), _hash);
+			_tracer.Record(LockEvent::Timeout, _hash);
+		}
+		return acquired;
+	}
+
+	void Unlock() override
+	{
+		if (this->IsLocked())
+		{
+			LOCK_TRACE_PROBE(release, _traceName.c_str(), _hash);
+			_tracer.Record(LockEvent::Release, _hash);
+		}
+		LinuxSharedMutex::Unlock();
+	}
+
+	void Release() override
+	{
+		if (this->IsLocked())
+		{
+			LOCK_TRACE_PROBE(release, _traceName.c_str(), _hash);
+			_tracer.Record(LockEvent::Release, _hash);
+		}
+		LinuxSharedMutex::Release();
+	}
+};
+
+#else
+
+#include "SharedMutex.hpp"
+
+typedef LinuxSharedMutex TracedSharedMutex;
+
+#endif
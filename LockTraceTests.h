@@ -0,0 +1,350 @@
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <signal.h>
+#include "LockTrace.hpp"
+#include "TestHelpers.h"
+
+constexpr TestName TRACE_PREFIX_1 = "TRACE_1";
+
+// Writes an event the way LockTracer::Record() does, for tests that do not depend on IPC_MUTEX_TRACE
+static void AppendTraceEvent(lock_trace_thread &thread, LockEvent type, uint64_t lock, uint64_t timestamp)
+{
+	const uint64_t head = thread.head.load();
+	thread.events[head % LOCK_TRACE_EVENTS] = { timestamp, lock, (uint32_t) type, 0 };
+	thread.head.store(head + 1);
+}
+
+static std::string TraceSegmentName(pid_t pid)
+{
+	return std::string(TRACE_PREFIX_1) + "." + std::to_string(pid);
+}
+
+//====================================================================================================
+//====================================================================================================
+
+void Test_LockTrace_SegmentsOfTwoProcesses_ReadBackMergedByTime()
+{
+	logtest(__func__);
+
+	const uint64_t lock = LockRegistry::Hash(SHARE_NAME_1);
+	SharedRegion first(TraceSegmentName(100).c_str(), sizeof(lock_trace_layout));
+	SharedRegion second(TraceSegmentName(200).c_str(), sizeof(lock_trace_layout));
+	first.Create();
+	second.Create();
+
+	auto firstLayout = first.GetAs<lock_trace_layout>();
+	firstLayout->pid = 100;
+	firstLayout->names[lock % LOCK_TRACE_NAMES].hash = lock;
+	strcpy(firstLayout->names[lock % LOCK_TRACE_NAMES].name, SHARE_NAME_1);
+	firstLayout->threads[0].tid = 101;
+	AppendTraceEvent(firstLayout->threads[0], LockEvent::AcquireStart, lock, 10);
+	AppendTraceEvent(firstLayout->threads[0], LockEvent::Acquired, lock, 30);
+
+	auto secondLayout = second.GetAs<lock_trace_layout>();
+	secondLayout->pid = 200;
+	secondLayout->threads[3].tid = 201;
+	AppendTraceEvent(secondLayout->threads[3], LockEvent::AcquireStart, 42, 20);
+	AppendTraceEvent(secondLayout->threads[3], LockEvent::Timeout, 42, 40);
+
+	std::vector<std::string> segments;
+	auto records = ReadLockTraces(std::string(TRACE_PREFIX_1), &segments);
+	DeleteLockTraces(segments);
+	auto recordsAfterDelete = ReadLockTraces(std::string(TRACE_PREFIX_1));
+
+	compare<size_t>(segments.size(), 2, "Both segments should be read");
+	compare<size_t>(records.size(), 4, "All events should be read");
+	for (size_t i = 0; i < records.size(); ++i)
+		compare<uint64_t>(records[i].timestamp, (i + 1) * 10, "Events should be merged by timestamp");
+	compare<pid_t>(records[1].pid, 200, "Event pid incorrect");
+	compare<pid_t>(records[1].tid, 201, "Event tid incorrect");
+	compare<int>((int) records[3].type, (int) LockEvent::Timeout, "Event type incorrect");
+	compare<std::string>(records[0].lock, std::string(SHARE_NAME_1), "Registered name should be resolved");
+	compare<std::string>(records[1].lock, "#42", "Unregistered name should show the hash");
+	compare<size_t>(recordsAfterDelete.size(), 0, "Deleted segments should not be read");
+}
+
+void Test_LockTrace_WrappedRing_SkipsSlotBeingOverwritten()
+{
+	logtest(__func__);
+
+	SharedRegion segment(TraceSegmentName(100).c_str(), sizeof(lock_trace_layout));
+	segment.Create();
+	auto layout = segment.GetAs<lock_trace_layout>();
+	layout->threads[0].tid = 101;
+	for (uint64_t i = 0; i < LOCK_TRACE_EVENTS + 5; ++i)
+		AppendTraceEvent(layout->threads[0], LockEvent::AcquireStart, 1, i);
+
+	std::vector<std::string> segments;
+	auto records = ReadLockTraces(std::string(TRACE_PREFIX_1), &segments);
+	DeleteLockTraces(segments);
+
+	// The oldest slot is the next one written, a reader cannot tell it from a torn event
+	compare<size_t>(records.size(), LOCK_TRACE_EVENTS - 1, "Only events that cannot be in the middle of an overwrite are valid");
+	compare<uint64_t>(records.front().timestamp, 6, "Oldest valid event incorrect");
+	compare<uint64_t>(records.back().timestamp, LOCK_TRACE_EVENTS + 4, "Newest event should be kept");
+}
+
+void Test_LockTrace_Export_WaitAndHoldSlices()
+{
+	logtest(__func__);
+
+	std::vector<LockTraceRecord> records {
+		{ 100, 101, 1000, LockEvent::AcquireStart, "L" },
+		{ 100, 101, 3000, LockEvent::Acquired,     "L" },
+		{ 200, 201, 4000, LockEvent::AcquireStart, "L" },
+		{ 100, 101, 9000, LockEvent::Release,      "L" },
+		{ 200, 201, 9500, LockEvent::Timeout,      "L" },
+		{ 200, 201, 9600, LockEvent::Release,      "\"M\"" },
+	};
+	const std::string json = ExportLockTraces(records);
+
+	auto contains = [&json](const std::string &part) { return json.find(part) != std::string::npos; };
+	assert(contains("{\"name\":\"wait L\",\"cat\":\"wait\",\"ph\":\"X\",\"pid\":100,\"tid\":101,\"ts\":1.000,\"dur\":2.000,\"args\":{\"result\":\"acquired\"}}"),
+		"Wait slice from acquire-start to acquired missing");
+	assert(contains("{\"name\":\"hold L\",\"cat\":\"hold\",\"ph\":\"X\",\"pid\":100,\"tid\":101,\"ts\":3.000,\"dur\":6.000}"),
+		"Hold slice from acquired to release missing");
+	assert(contains("\"name\":\"wait L\",\"cat\":\"wait\",\"ph\":\"X\",\"pid\":200,\"tid\":201,\"ts\":4.000,\"dur\":5.500,\"args\":{\"result\":\"timeout\"}"),
+		"Wait slice ending in a timeout missing");
+	assert(contains("{\"name\":\"timeout L\",\"cat\":\"timeout\",\"ph\":\"i\""), "Timeout instant event missing");
+	assert(!contains("hold \\\"M\\\""), "Release without acquire should not become a slice");
+	assert(contains("\"args\":{\"name\":\"pid 200\"}"), "Process name missing");
+}
+
+#ifdef IPC_MUTEX_TRACE
+
+static std::vector<LockTraceRecord> RecordsOf(const std::vector<LockTraceRecord> &records, pid_t pid)
+{
+	std::vector<LockTraceRecord> matching;
+	for (auto &record : records)
+	{
+		if (record.pid == pid)
+			matching.push_back(record);
+	}
+	return matching;
+}
+
+void Test_LockTrace_RecordedEvents_ReadBackInOrder()
+{
+	logtest(__func__);
+
+	LockTracer tracer(TRACE_PREFIX_1);
+	auto lock = tracer.RegisterName(SHARE_NAME_1);
+	tracer.Record(LockEvent::AcquireStart, lock);
+	tracer.Record(LockEvent::Acquired, lock);
+	tracer.Record(LockEvent::Release, lock);
+
+	std::vector<std::string> segments;
+	auto records = ReadLockTraces(std::string(TRACE_PREFIX_1), &segments);
+	DeleteLockTraces(segments);
+
+	compare<size_t>(segments.size(), 1, "One trace segment per process expected");
+	compare<size_t>(records.size(), 3, "Recorded events not read back");
+	compare<int>((int) records[0].type, (int) LockEvent::AcquireStart, "Events out of order");
+	compare<int>((int) records[1].type, (int) LockEvent::Acquired, "Events out of order");
+	compare<int>((int) records[2].type, (int) LockEvent::Release, "Events out of order");
+	compare<std::string>(records[0].lock, std::string(SHARE_NAME_1), "Lock name not resolved");
+	compare<pid_t>(records[0].pid, getpid(), "Event pid incorrect");
+	assert(records[0].timestamp <= records[2].timestamp, "Timestamps not monotonic");
+}
+
+void Test_LockTrace_RingBufferFull_KeepsNewestEvents()
+{
+	logtest(__func__);
+
+	LockTracer tracer(TRACE_PREFIX_1);
+	auto lock = tracer.RegisterName(SHARE_NAME_1);
+	for (unsigned int i = 0; i < LOCK_TRACE_EVENTS; ++i)
+		tracer.Record(LockEvent::AcquireStart, lock);
+	tracer.Record(LockEvent::Timeout, lock);
+
+	std::vector<std::string> segments;
+	auto records = ReadLockTraces(std::string(TRACE_PREFIX_1), &segments);
+	DeleteLockTraces(segments);
+
+	compare<size_t>(records.size(), LOCK_TRACE_EVENTS - 1, "Ring buffer should keep its capacity of events, less the slot written next");
+	compare<int>((int) records.back().type, (int) LockEvent::Timeout, "Newest event should be kept");
+}
+
+void Test_LockTrace_TracedMutex_RecordsLockEvents()
+{
+	logtest(__func__);
+
+	LockTracer tracer(TRACE_PREFIX_1);
+	{
+		TracedSharedMutex mutex(SHARE_NAME_1, tracer);
+		mutex.TryLock(0);
+		mutex.Unlock();
+	}
+
+	std::vector<std::string> segments;
+	auto records = ReadLockTraces(std::string(TRACE_PREFIX_1), &segments);
+	DeleteLockTraces(segments);
+
+	compare<size_t>(records.size(), 3, "Traced mutex should record three events");
+	compare<int>((int) records[0].type, (int) LockEvent::AcquireStart, "First event should be acquire-start");
+	compare<int>((int) records[1].type, (int) LockEvent::Acquired, "Second event should be acquired");
+	compare<int>((int) records[2].type, (int) LockEvent::Release, "Third event should be release");
+}
+
+void Test_LockTrace_TwoProcesses_TracesMerged()
+{
+	logtest(__func__);
+
+	LockTracer tracer(TRACE_PREFIX_1);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		TracedSharedMutex mutex(SHARE_NAME_1, tracer);
+		barrier.Arrive(); // Parent holds the lock
+		mutex.TryLock(WAIT_TIME_1);
+		barrier.Arrive(); // Timed out
+		ExitChild();
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		TracedSharedMutex mutex(SHARE_NAME_1, tracer);
+		mutex.TryLock(0);
+		barrier.Arrive();
+		barrier.Arrive();
+		mutex.Unlock();
+
+		StopChild(childPid);
+
+		std::vector<std::string> segments;
+		auto records = ReadLockTraces(std::string(TRACE_PREFIX_1), &segments);
+		DeleteLockTraces(segments);
+
+		auto parentRecords = RecordsOf(records, getpid());
+		auto childRecords = RecordsOf(records, childPid);
+
+		compare<size_t>(segments.size(), 2, "Each process should write its own segment");
+		compare<size_t>(parentRecords.size(), 3, "Parent events missing");
+		compare<size_t>(childRecords.size(), 2, "Child events missing");
+		compare<int>((int) childRecords[1].type, (int) LockEvent::Timeout, "Child should record a timeout");
+		assert(parentRecords[1].timestamp < childRecords[1].timestamp, "Merged events should be ordered by time");
+	}
+}
+
+void Test_LockTrace_BufferOfExitedThreadReused_OldEventsDropped()
+{
+	logtest(__func__);
+
+	LockTracer tracer(TRACE_PREFIX_1);
+	auto lock = tracer.RegisterName(SHARE_NAME_1);
+
+	// Every buffer is taken by a thread that exited
+	for (unsigned int i = 0; i < LOCK_TRACE_THREADS; ++i)
+	{
+		std::thread([&tracer, lock] {
+			tracer.Record(LockEvent::AcquireStart, lock);
+			tracer.Record(LockEvent::Acquired, lock);
+		}).join();
+	}
+
+	pid_t tid = 0;
+	std::thread([&tracer, lock, &tid] {
+		tid = (pid_t) syscall(SYS_gettid);
+		tracer.Record(LockEvent::Release, lock);
+	}).join();
+
+	std::vector<std::string> segments;
+	auto records = ReadLockTraces(std::string(TRACE_PREFIX_1), &segments);
+	DeleteLockTraces(segments);
+
+	std::vector<LockTraceRecord> reused;
+	for (auto &record : records)
+	{
+		if (record.tid == tid)
+			reused.push_back(record);
+	}
+
+	compare<size_t>(records.size(), (LOCK_TRACE_THREADS - 1) * 2 + 1, "Events of the exited thread should be dropped with its buffer");
+	compare<size_t>(reused.size(), 1, "New thread should only show its own events");
+	compare<int>((int) reused[0].type, (int) LockEvent::Release, "New thread's event incorrect");
+}
+
+void Test_LockTrace_AllBuffersTaken_EveryLostEventCounted()
+{
+	logtest(__func__);
+
+	LockTracer tracer(TRACE_PREFIX_1);
+	auto lock = tracer.RegisterName(SHARE_NAME_1);
+
+	// Every buffer is taken by a live thread
+	std::atomic<unsigned int> recorded(0);
+	std::atomic<bool> done(false);
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < LOCK_TRACE_THREADS; ++i)
+	{
+		threads.emplace_back([&tracer, lock, &recorded, &done] {
+			tracer.Record(LockEvent::AcquireStart, lock);
+			++recorded;
+			while (!done)
+				SleepFor(1);
+		});
+	}
+	while (recorded < LOCK_TRACE_THREADS)
+		SleepFor(1);
+
+	std::thread([&tracer, lock] {
+		tracer.Record(LockEvent::AcquireStart, lock);
+		tracer.Record(LockEvent::Acquired, lock);
+		tracer.Record(LockEvent::Release, lock);
+	}).join();
+	done = true;
+	for (auto &thread : threads)
+		thread.join();
+
+	SharedRegion segment(TraceSegmentName(getpid()).c_str(), sizeof(lock_trace_layout));
+	segment.Create();
+	const uint64_t dropped = segment.GetAs<lock_trace_layout>()->dropped.load();
+	segment.Destroy();
+
+	compare<uint64_t>(dropped, 3, "Every event of a thread without buffer should be counted");
+}
+
+//====================================================================================================
+//====================================================================================================
+
+static std::vector<TestCase> GetLockTraceTests()
+{
+	return std::vector<TestCase> {
+		TEST_CASE(Test_LockTrace_SegmentsOfTwoProcesses_ReadBackMergedByTime),
+		TEST_CASE(Test_LockTrace_WrappedRing_SkipsSlotBeingOverwritten),
+		TEST_CASE(Test_LockTrace_Export_WaitAndHoldSlices),
+		TEST_CASE(Test_LockTrace_RecordedEvents_ReadBackInOrder),
+		TEST_CASE(Test_LockTrace_RingBufferFull_KeepsNewestEvents),
+		TEST_CASE(Test_LockTrace_TracedMutex_RecordsLockEvents),
+		TEST_CASE(Test_LockTrace_TwoProcesses_TracesMerged),
+		TEST_CASE(Test_LockTrace_BufferOfExitedThreadReused_OldEventsDropped),
+		TEST_CASE(Test_LockTrace_AllBuffersTaken_EveryLostEventCounted),
+	};
+}
+
+#else
+
+// Recording is compiled out, build with -DIPC_MUTEX_TRACE=ON to run the LockTracer tests as well
+static std::vector<TestCase> GetLockTraceTests()
+{
+	return std::vector<TestCase> {
+		TEST_CASE(Test_LockTrace_SegmentsOfTwoProcesses_ReadBackMergedByTime),
+		TEST_CASE(Test_LockTrace_WrappedRing_SkipsSlotBeingOverwritten),
+		TEST_CASE(Test_LockTrace_Export_WaitAndHoldSlices),
+	};
+}
+
+#endif
@@ -0,0 +1,688 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <unistd.h>
+#include "SharedMutex.hpp"
+#include "SharedRegion.hpp"
+#include "SharedLifecycle.hpp"
+#include "SharedFutex.hpp"
+#include "ForkGeneration.hpp"
+
+constexpr size_t       SHARED_ARENA_SIZE           = (size_t) 1 << 20;  /* Initial size of the shared file */
+constexpr size_t       SHARED_ARENA_RESERVE        = (size_t) 1 << 32;  /* Address range the arena can grow into */
+constexpr unsigned int SHARED_ARENA_CLASSES        = 40;   /* Block sizes are 16 bytes << class */
+constexpr unsigned int SHARED_ARENA_CACHED_CLASSES = 9;    /* Blocks up to 4 KiB are cached per process */
+constexpr unsigned int SHARED_ARENA_CACHE_BLOCKS   = 32;   /* Cached blocks per class and process */
+constexpr unsigned int SHARED_ARENA_ROOTS          = 16;   /* Named entry points into the arena */
+constexpr uint32_t     SHARED_ARENA_MAGIC          = 0x41524e41;
+
+/*
+* Pointer into shared memory that stays valid in every process.
+* - Stores the distance from itself to the target, so it only works while
+*   both are in the same mapping, i.e. inside one SharedArena
+* - A distance of 0 is null, so zero-filled memory holds null pointers
+*/
+template <typename T>
+class offset_ptr
+{
+private:
+	std::ptrdiff_t _offset;
+
+public:
+	offset_ptr() : _offset(0) {}
+	offset_ptr(T *target) { Set(target); }
+	offset_ptr(const offset_ptr &other) { Set(other.get()); }
+
+	offset_ptr& operator=(const offset_ptr &other) { Set(other.get()); return *this; }
+	offset_ptr& operator=(T *target) { Set(target); return *this; }
+
+	T* get() const
+	{
+		if (_offset == 0)
+			return nullptr;
+		return reinterpret_cast<T*>(const_cast<char*>(reinterpret_cast<const char*>(this)) + _offset);
+	}
+
+	T* operator->() const { return get(); }
+	T& operator*() const { return *get(); }
+	T& operator[](size_t index) const { return get()[index]; }
+	explicit operator bool() const { return _offset != 0; }
+
+private:
+	void Set(T *target)
+	{
+		_offset = target == nullptr ? 0 : reinterpret_cast<char*>(target) - reinterpret_cast<char*>(this);
+	}
+};
+
+/*
+* Every block starts with this header. The payload follows it 16-byte aligned.
+*/
+struct shared_arena_block {
+	uint32_t sizeClass;     // Block size is 16 << sizeClass, header included
+	uint32_t magic;         // SHARED_ARENA_MAGIC while allocated
+	uint64_t next;          // Offset of the next free block of the class, while free
+};
+
+static_assert(sizeof(shared_arena_block) == 16, "Block header must keep payloads 16-byte aligned");
+
+/*
+* This struct is what is mapped to memory, the arena's blocks follow it.
+* Offsets are counted from the start of the mapping, 0 is none.
+*/
+struct shared_arena_layout {
+	shared_region_layout  header;
+	std::atomic<uint32_t> lock;                             // Allocator lock, see FutexLock()
+	uint64_t              reserve;                          // Address range every process maps
+	std::atomic<uint64_t> capacity;                         // Current size of the shared file
+	uint64_t              top;                              // First never allocated byte
+	uint64_t              freeLists[SHARED_ARENA_CLASSES];  // First free block of each class
+	std::atomic<uint64_t> roots[SHARED_ARENA_ROOTS];        // Objects created by Root()
+};
+
+/*
+* - Allocates memory inside a named shared file, for data structures shared by
+*   all processes without copying. Pointers between such objects must be
+*   offset_ptr, see shared_vector and shared_hash_map
+* - The shared file starts at initialSize and doubles when it runs full.
+*   Every process maps the whole reserve up front, so the arena grows without
+*   moving and without remapping. The first process sets the reserve
+* - Blocks come in power-of-two size classes, each with a shared free list.
+*   Small blocks go through a per-process cache that is refilled and flushed
+*   in batches, so most Allocate()/Deallocate() calls take no shared lock.
+*   The shared lock is a futex owned by a pid: a process killed while
+*   allocating does not block the others, they take the lock over
+* - The allocator is safe to use from all processes at once. The data
+*   structures are not, guard them with TryLock()/Unlock(), the arena's
+*   named mutex
+* - Follows the lifecycle of LinuxSharedMutex except for the stale timestamp:
+*   the arena is deleted when the last user releases it, never for its age
+*/
+class SharedArena
+{
+private:
+	struct ProcessCache {
+		uint64_t     blocks[SHARED_ARENA_CACHE_BLOCKS];
+		unsigned int count;
+	};
+
+	const std::string             _name;
+	std::unique_ptr<SharedRegion> _share;
+	LinuxSharedMutex              _mutex;
+	std::mutex                    _cacheMutex;
+	ProcessCache                  _caches[SHARED_ARENA_CACHED_CLASSES];
+	unsigned int                  _cacheGeneration;
+
+public:
+	SharedArena(const char *name, size_t initialSize = SHARED_ARENA_SIZE, size_t reserve = SHARED_ARENA_RESERVE)
+		: _name(name), _mutex((std::string(name) + ".mutex").c_str()), _caches(), _cacheGeneration(ForkGeneration())
+	{
+		const size_t size = RoundToPage(std::max(initialSize, DataStart() + sizeof(shared_arena_block)));
+		reserve = std::max(RoundToPage(reserve), size);
+
+		_share.reset(new SharedRegion(name, size, reserve));
+		AttachSharedRegion(*_share, [this, size, reserve] {
+			auto layout = Layout();
+			layout->reserve = reserve;
+			layout->capacity = size;
+			layout->top = DataStart();
+		}, 0);
+
+		// The arena was created with a larger reserve, map all of it
+		auto layout = Layout();
+		if (layout != nullptr && layout->reserve > _share->Reserved())
+		{
+			const size_t stored = layout->reserve;
+			_share.reset(new SharedRegion(name, size, stored));
+			_share->Create();
+		}
+	}
+
+	virtual ~SharedArena()
+	{
+		this->Release();
+	}
+
+	const std::string& Name() const { return _name; }
+	bool IsCreated() const { return Layout() != nullptr; }
+	size_t Capacity() const { return Layout() ? Layout()->capacity.load() : 0; }
+	size_t Reserved() const { return Layout() ? Layout()->reserve : 0; }
+
+	// Guards the data structures in the arena across processes
+	bool TryLock(int timeout) { return _mutex.TryLock(timeout); }
+	void Unlock() { _mutex.Unlock(); }
+
+	// Returns nullptr when the arena cannot grow any further
+	void* Allocate(size_t bytes)
+	{
+		const unsigned int sizeClass = SizeClass(bytes);
+		if (sizeClass >= SHARED_ARENA_CLASSES || Layout() == nullptr)
+			return nullptr;
+
+		uint64_t offset = 0;
+		if (sizeClass < SHARED_ARENA_CACHED_CLASSES)
+			offset = AllocateCached(sizeClass);
+		else
+		{
+			SharedFutexGuard guard(Layout()->lock);
+			offset = AllocateShared(sizeClass);
+		}
+		if (offset == 0)
+			return nullptr;
+
+		auto block = At<shared_arena_block>(offset);
+		block->magic = SHARED_ARENA_MAGIC;
+		return block + 1;
+	}
+
+	// Blocks can be returned by any process, not only the allocating one
+	void Deallocate(void *pointer)
+	{
+		if (pointer == nullptr || Layout() == nullptr)
+			return;
+
+		auto block = static_cast<shared_arena_block*>(pointer) - 1;
+		if (block->magic != SHARED_ARENA_MAGIC || block->sizeClass >= SHARED_ARENA_CLASSES)
+			return; // Not from this arena, or freed twice
+		block->magic = 0;
+
+		const uint64_t offset = OffsetOf(block);
+		if (block->sizeClass < SHARED_ARENA_CACHED_CLASSES)
+			DeallocateCached(block->sizeClass, offset);
+		else
+		{
+			SharedFutexGuard guard(Layout()->lock);
+			DeallocateShared(offset);
+		}
+	}
+
+	template <typename T, typename... Args>
+	T* Construct(Args&&... args)
+	{
+		static_assert(alignof(T) <= sizeof(shared_arena_block), "Arena blocks are only 16-byte aligned");
+		void *memory = Allocate(sizeof(T));
+		return memory ? new (memory) T(std::forward<Args>(args)...) : nullptr;
+	}
+
+	template <typename T>
+	void Destroy(T *object)
+	{
+		if (object == nullptr)
+			return;
+		object->~T();
+		Deallocate(object);
+	}
+
+	/*
+	* Returns the object in the given root slot, default constructing it on
+	* first use. This is how processes find shared data structures by name.
+	* The constructor of T runs under the allocator lock and must not allocate
+	*/
+	template <typename T>
+	T* Root(unsigned int slot)
+	{
+		static_assert(alignof(T) <= sizeof(shared_arena_block), "Arena blocks are only 16-byte aligned");
+		auto layout = Layout();
+		if (layout == nullptr || slot >= SHARED_ARENA_ROOTS)
+			return nullptr;
+
+		uint64_t offset = layout->roots[slot].load(std::memory_order_acquire);
+		if (offset == 0)
+		{
+			SharedFutexGuard guard(layout->lock);
+			offset = layout->roots[slot].load(std::memory_order_relaxed);
+			if (offset == 0)
+			{
+				const uint64_t blockOffset = AllocateShared(SizeClass(sizeof(T)));
+				if (blockOffset == 0)
+					return nullptr;
+				auto block = At<shared_arena_block>(blockOffset);
+				block->magic = SHARED_ARENA_MAGIC;
+				new (block + 1) T();
+				offset = blockOffset + sizeof(shared_arena_block);
+				layout->roots[slot].store(offset, std::memory_order_release);
+			}
+		}
+		return At<T>(offset);
+	}
+
+	void Release()
+	{
+		if (Layout() == nullptr)
+			return;
+
+		FlushCaches();
+		DetachSharedRegion(*_share);
+		_mutex.Release();
+	}
+
+	void Delete()
+	{
+		_share->Destroy();
+		_mutex.Release();
+	}
+
+private:
+	shared_arena_layout* Layout() const
+	{
+		return _share ? _share->GetAs<shared_arena_layout>() : nullptr;
+	}
+
+	template <typename T>
+	T* At(uint64_t offset) const
+	{
+		return reinterpret_cast<T*>(reinterpret_cast<char*>(Layout()) + offset);
+	}
+
+	uint64_t OffsetOf(const void *pointer) const
+	{
+		return static_cast<const char*>(pointer) - reinterpret_cast<const char*>(Layout());
+	}
+
+	// Needs the allocator lock
+	uint64_t AllocateShared(unsigned int sizeClass)
+	{
+		auto layout = Layout();
+		uint64_t offset = layout->freeLists[sizeClass];
+		if (offset != 0)
+		{
+			layout->freeLists[sizeClass] = At<shared_arena_block>(offset)->next;
+			return offset;
+		}
+
+		const uint64_t blockSize = BlockSize(sizeClass);
+		if (layout->top + blockSize > layout->capacity && !Grow(layout->top + blockSize))
+			return 0;
+
+		offset = layout->top;
+		layout->top += blockSize;
+		At<shared_arena_block>(offset)->sizeClass = sizeClass;
+		return offset;
+	}
+
+	// Needs the allocator lock
+	void DeallocateShared(uint64_t offset)
+	{
+		auto layout = Layout();
+		auto block = At<shared_arena_block>(offset);
+		block->next = layout->freeLists[block->sizeClass];
+		layout->freeLists[block->sizeClass] = offset;
+	}
+
+	// Needs the allocator lock
+	bool Grow(uint64_t required)
+	{
+		auto layout = Layout();
+		if (required > layout->reserve)
+			return false;
+
+		uint64_t capacity = std::max<uint64_t>(layout->capacity * 2, RoundToPage(required));
+		capacity = std::min<uint64_t>(capacity, layout->reserve);
+		if (!_share->Grow(capacity))
+			return false;
+
+		layout->capacity.store(capacity, std::memory_order_release);
+		return true;
+	}
+
+	uint64_t AllocateCached(unsigned int sizeClass)
+	{
+		std::lock_guard<std::mutex> lock(_cacheMutex);
+		auto &cache = ThisProcessCache(sizeClass);
+		if (cache.count == 0)
+		{
+			SharedFutexGuard guard(Layout()->lock);
+			while (cache.count < SHARED_ARENA_CACHE_BLOCKS / 2)
+			{
+				const uint64_t offset = AllocateShared(sizeClass);
+				if (offset == 0)
+					break;
+				cache.blocks[cache.count++] = offset;
+			}
+		}
+		return cache.count == 0 ? 0 : cache.blocks[--cache.count];
+	}
+
+	void DeallocateCached(unsigned int sizeClass, uint64_t offset)
+	{
+		std::lock_guard<std::mutex> lock(_cacheMutex);
+		auto &cache = ThisProcessCache(sizeClass);
+		if (cache.count == SHARED_ARENA_CACHE_BLOCKS)
+		{
+			SharedFutexGuard guard(Layout()->lock);
+			while (cache.count > SHARED_ARENA_CACHE_BLOCKS / 2)
+				DeallocateShared(cache.blocks[--cache.count]);
+		}
+		cache.blocks[cache.count++] = offset;
+	}
+
+	// Needs the cache lock
+	ProcessCache& ThisProcessCache(unsigned int sizeClass)
+	{
+		// A forked child inherits the cache, but the blocks in it still belong to the parent
+		if (_cacheGeneration != ForkGenerationCounter())
+		{
+			for (auto &cache : _caches)
+				cache.count = 0;
+			_cacheGeneration = ForkGenerationCounter();
+		}
+		return _caches[sizeClass];
+	}
+
+	void FlushCaches()
+	{
+		std::lock_guard<std::mutex> lock(_cacheMutex);
+		SharedFutexGuard guard(Layout()->lock);
+		for (unsigned int sizeClass = 0; sizeClass < SHARED_ARENA_CACHED_CLASSES; ++sizeClass)
+		{
+			auto &cache = ThisProcessCache(sizeClass);
+			while (cache.count > 0)
+				DeallocateShared(cache.blocks[--cache.count]);
+		}
+	}
+
+	static constexpr size_t DataStart()
+	{
+		return (sizeof(shared_arena_layout) + 63) & ~(size_t) 63;
+	}
+
+	static constexpr uint64_t BlockSize(unsigned int sizeClass)
+	{
+		return (uint64_t) sizeof(shared_arena_block) << sizeClass;
+	}
+
+	static unsigned int SizeClass(size_t bytes)
+	{
+		const uint64_t required = (uint64_t) bytes + sizeof(shared_arena_block);
+		unsigned int sizeClass = 0;
+		while (sizeClass < SHARED_ARENA_CLASSES && BlockSize(sizeClass) < required)
+			++sizeClass;
+		return sizeClass;
+	}
+
+	static size_t RoundToPage(size_t size)
+	{
+		const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+		return (size + page - 1) / page * page;
+	}
+};
+
+
+/*
+* Byte-wise FNV-1a hash, the default for shared_hash_map keys.
+* Keys must be trivially copyable and free of padding bytes.
+*/
+template <typename K>
+struct shared_hash
+{
+	static_assert(std::is_trivially_copyable<K>::value, "Hash keys byte-wise or pass a hash for this key type");
+
+	uint64_t operator()(const K &key) const
+	{
+		auto bytes = reinterpret_cast<const unsigned char*>(&key);
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < sizeof(K); ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+};
+
+
+/*
+* Growable array in a SharedArena.
+* - The vector itself must live in the arena, see SharedArena::Root()
+* - Calls that allocate take the arena as their first argument and return
+*   false when it is full
+* - T must not hold raw pointers. Elements are moved with their move
+*   constructor when the vector grows
+*/
+template <typename T>
+class shared_vector
+{
+private:
+	offset_ptr<T> _data;
+	uint64_t      _size;
+	uint64_t      _capacity;
+
+public:
+	shared_vector() : _size(0), _capacity(0) {}
+	shared_vector(const shared_vector&) = delete;
+	shared_vector& operator=(const shared_vector&) = delete;
+
+	size_t size() const { return _size; }
+	size_t capacity() const { return _capacity; }
+	bool empty() const { return _size == 0; }
+
+	T* data() const { return _data.get(); }
+	T* begin() const { return data(); }
+	T* end() const { return data() + _size; }
+	T& operator[](size_t index) const { return data()[index]; }
+	T& back() const { return data()[_size - 1]; }
+
+	bool reserve(SharedArena &arena, size_t capacity)
+	{
+		if (capacity <= _capacity)
+			return true;
+		if (capacity > SIZE_MAX / sizeof(T))
+			return false;
+
+		T *grown = static_cast<T*>(arena.Allocate(capacity * sizeof(T)));
+		if (grown == nullptr)
+			return false;
+
+		T *old = data();
+		for (uint64_t i = 0; i < _size; ++i)
+		{
+			new (&grown[i]) T(std::move(old[i]));
+			old[i].~T();
+		}
+		arena.Deallocate(old);
+
+		_data = grown;
+		_capacity = capacity;
+		return true;
+	}
+
+	template <typename... Args>
+	bool emplace_back(SharedArena &arena, Args&&... args)
+	{
+		if (_size == _capacity && !reserve(arena, _capacity == 0 ? 8 : _capacity * 2))
+			return false;
+		new (&data()[_size]) T(std::forward<Args>(args)...);
+		++_size;
+		return true;
+	}
+
+	bool push_back(SharedArena &arena, const T &value)
+	{
+		return emplace_back(arena, value);
+	}
+
+	void pop_back()
+	{
+		if (_size > 0)
+			data()[--_size].~T();
+	}
+
+	void clear()
+	{
+		while (_size > 0)
+			pop_back();
+	}
+
+	// Frees the elements, the vector can be reused afterwards
+	void destroy(SharedArena &arena)
+	{
+		clear();
+		arena.Deallocate(data());
+		_data = nullptr;
+		_capacity = 0;
+	}
+};
+
+
+/*
+* Hash map with separate chaining in a SharedArena.
+* - The map itself must live in the arena, see SharedArena::Root()
+* - Calls that allocate take the arena as their first argument
+* - The bucket array doubles when the map holds more entries than buckets.
+*   Entries never move, pointers to values stay valid until erased
+* - K and V must not hold raw pointers
+*/
+template <typename K, typename V, typename Hash = shared_hash<K>>
+class shared_hash_map
+{
+private:
+	struct node {
+		offset_ptr<node> next;
+		uint64_t         hash;
+		K                key;
+		V                value;
+	};
+
+	offset_ptr<offset_ptr<node>> _buckets;
+	uint64_t                     _bucketCount;
+	uint64_t                     _size;
+
+public:
+	shared_hash_map() : _bucketCount(0), _size(0) {}
+	shared_hash_map(const shared_hash_map&) = delete;
+	shared_hash_map& operator=(const shared_hash_map&) = delete;
+
+	size_t size() const { return _size; }
+	bool empty() const { return _size == 0; }
+
+	V* find(const K &key) const
+	{
+		if (_bucketCount == 0)
+			return nullptr;
+
+		const uint64_t hash = Hash()(key);
+		for (node *entry = _buckets[hash & (_bucketCount - 1)].get(); entry != nullptr; entry = entry->next.get())
+		{
+			if (entry->hash == hash && entry->key == key)
+				return &entry->value;
+		}
+		return nullptr;
+	}
+
+	// Inserts or overwrites, returns the stored value or nullptr when the arena is full
+	V* insert(SharedArena &arena, const K &key, const V &value)
+	{
+		V *found = find(key);
+		if (found != nullptr)
+		{
+			*found = value;
+			return found;
+		}
+
+		if (_size + 1 > _bucketCount)
+			rehash(arena, _bucketCount == 0 ? 16 : _bucketCount * 2);
+		if (_bucketCount == 0)
+			return nullptr;
+
+		node *entry = static_cast<node*>(arena.Allocate(sizeof(node)));
+		if (entry == nullptr)
+			return nullptr;
+		new (entry) node{ offset_ptr<node>(), Hash()(key), key, value };
+
+		auto &bucket = _buckets[entry->hash & (_bucketCount - 1)];
+		entry->next = bucket;
+		bucket = entry;
+		++_size;
+		return &entry->value;
+	}
+
+	bool erase(SharedArena &arena, const K &key)
+	{
+		if (_bucketCount == 0)
+			return false;
+
+		const uint64_t hash = Hash()(key);
+		for (offset_ptr<node> *link = &_buckets[hash & (_bucketCount - 1)]; *link; link = &(*link)->next)
+		{
+			node *entry = link->get();
+			if (entry->hash == hash && entry->key == key)
+			{
+				*link = entry->next;
+				entry->~node();
+				arena.Deallocate(entry);
+				--_size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <typename F>
+	void for_each(F function) const
+	{
+		for (uint64_t i = 0; i < _bucketCount; ++i)
+		{
+			for (node *entry = _buckets[i].get(); entry != nullptr; entry = entry->next.get())
+				function(entry->key, entry->value);
+		}
+	}
+
+	// Frees all entries, the map can be reused afterwards
+	void destroy(SharedArena &arena)
+	{
+		for (uint64_t i = 0; i < _bucketCount; ++i)
+		{
+			node *entry = _buckets[i].get();
+			while (entry != nullptr)
+			{
+				node *next = entry->next.get();
+				entry->~node();
+				arena.Deallocate(entry);
+				entry = next;
+			}
+		}
+		arena.Deallocate(_buckets.get());
+		_buckets = nullptr;
+		_bucketCount = 0;
+		_size = 0;
+	}
+
+private:
+	// Keeps the current buckets when the arena is full. bucketCount is a power of two
+	bool rehash(SharedArena &arena, size_t bucketCount)
+	{
+		auto buckets = static_cast<offset_ptr<node>*>(arena.Allocate(bucketCount * sizeof(offset_ptr<node>)));
+		if (buckets == nullptr)
+			return false;
+		for (size_t i = 0; i < bucketCount; ++i)
+			new (&buckets[i]) offset_ptr<node>();
+
+		for (uint64_t i = 0; i < _bucketCount; ++i)
+		{
+			node *entry = _buckets[i].get();
+			while (entry != nullptr)
+			{
+				node *next = entry->next.get();
+				auto &bucket = buckets[entry->hash & (bucketCount - 1)];
+				entry->next = bucket;
+				bucket = entry;
+				entry = next;
+			}
+		}
+
+		arena.Deallocate(_buckets.get());
+		_buckets = buckets;
+		_bucketCount = bucketCount;
+		return true;
+	}
+};
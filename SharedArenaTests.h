@@ -0,0 +1,304 @@
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <signal.h>
+#include "SharedArena.hpp"
+#include "TestHelpers.h"
+
+constexpr TestName ARENA_NAME_1 = "SHARED_ARENA_1";
+
+constexpr size_t   ARENA_SIZE_1    = 64 * 1024;
+constexpr size_t   ARENA_RESERVE_1 = 16 * 1024 * 1024;
+
+//====================================================================================================
+//====================================================================================================
+
+void Test_SharedArena_Deallocate_BlockReused()
+{
+	logtest(__func__);
+
+	SharedArena arena(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+	void *first = arena.Allocate(100);
+	arena.Deallocate(first);
+	void *second = arena.Allocate(100);
+	void *large = arena.Allocate(100000);
+	arena.Deallocate(large);
+	void *largeAgain = arena.Allocate(100000);
+
+	assert(first != nullptr, "Allocation failed");
+	assert(second == first, "Freed block of the same size class should be reused");
+	assert(largeAgain == large, "Freed large block should be reused");
+	compare<size_t>(reinterpret_cast<uintptr_t>(first) % 16, 0, "Allocations should be 16-byte aligned");
+}
+
+void Test_SharedArena_AllocateBeyondSize_ArenaGrows()
+{
+	logtest(__func__);
+
+	SharedArena arena(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+	auto first = static_cast<char*>(arena.Allocate(1000));
+	memset(first, 'a', 1000);
+
+	std::vector<void*> blocks;
+	for (int i = 0; i < 100; ++i)
+		blocks.push_back(arena.Allocate(10000));
+	auto beyondReserve = arena.Allocate(ARENA_RESERVE_1);
+
+	assert(arena.Capacity() > ARENA_SIZE_1, "Arena did not grow");
+	assert(arena.Capacity() <= ARENA_RESERVE_1, "Arena grew beyond its reserve");
+	assert(blocks.back() != nullptr, "Allocation after growing failed");
+	assert(first[0] == 'a' && first[999] == 'a', "Data moved while the arena grew");
+	assert(beyondReserve == nullptr, "Allocation beyond the reserve should fail");
+}
+
+void Test_SharedArena_Containers_StoreAndFind()
+{
+	logtest(__func__);
+
+	SharedArena arena(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+	auto vector = arena.Root<shared_vector<int>>(0);
+	auto map = arena.Root<shared_hash_map<int, int>>(1);
+	for (int i = 0; i < 10000; ++i)
+	{
+		vector->push_back(arena, i);
+		map->insert(arena, i, i * 2);
+	}
+	for (int i = 0; i < 10000; i += 2)
+		map->erase(arena, i);
+	map->insert(arena, 1, -1);
+
+	compare<size_t>(vector->size(), 10000, "Vector size incorrect");
+	compare<int>((*vector)[9999], 9999, "Vector element incorrect");
+	compare<size_t>(map->size(), 5000, "Map size incorrect");
+	assert(map->find(2) == nullptr, "Erased key still found");
+	compare<int>(*map->find(3), 6, "Map value incorrect");
+	compare<int>(*map->find(1), -1, "Inserting an existing key should overwrite it");
+	assert(arena.Root<shared_vector<int>>(0) == vector, "Root should return the existing object");
+}
+
+void Test_SharedArena_TwoProcesses_ShareContainersWithoutCopy()
+{
+	logtest(__func__);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		barrier.Arrive(); // Parent filled the map
+		{
+			SharedArena arena(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+			arena.TryLock(WAIT_TIME_2);
+			auto map = arena.Root<shared_hash_map<int, int>>(0);
+			auto vector = arena.Root<shared_vector<int>>(1);
+			map->for_each([&arena, vector](const int &key, const int &value) {
+				if (value == key * 3)
+					vector->push_back(arena, key);
+			});
+			// Grow the arena from this process
+			for (int i = 0; i < 100000; ++i)
+				vector->push_back(arena, -1);
+			arena.Unlock();
+		}
+		barrier.Arrive();
+		ExitChild();
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		SharedArena arena(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+		arena.TryLock(WAIT_TIME_2);
+		auto map = arena.Root<shared_hash_map<int, int>>(0);
+		for (int i = 0; i < 1000; ++i)
+			map->insert(arena, i, i * 3);
+		const size_t capacity = arena.Capacity();
+		arena.Unlock();
+
+		barrier.Arrive();
+		barrier.Arrive(); // Child read the map
+		StopChild(childPid);
+
+		arena.TryLock(WAIT_TIME_2);
+		auto vector = arena.Root<shared_vector<int>>(1);
+		const size_t size = vector->size();
+		long sum = 0;
+		for (int i = 0; i < 1000 && i < (int) size; ++i)
+			sum += (*vector)[i];
+		arena.Unlock();
+
+		compare<size_t>(size, 101000, "Child's vector not visible");
+		compare<long>(sum, 999 * 1000 / 2, "Child did not read the map");
+		assert(arena.Capacity() > capacity, "Child did not grow the arena");
+	}
+}
+
+void Test_SharedArena_Fork_CacheNotShared()
+{
+	logtest(__func__);
+
+	SharedArena arena(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+	arena.Deallocate(arena.Allocate(32)); // Fill this process' cache
+	auto childBlock = arena.Root<shared_vector<uint64_t>>(0);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		auto block = static_cast<char*>(arena.Allocate(32));
+		childBlock->push_back(arena, reinterpret_cast<uintptr_t>(block));
+		barrier.Arrive();
+		ExitChild();
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		barrier.Arrive(); // Child allocated
+		auto block = static_cast<char*>(arena.Allocate(32));
+		StopChild(childPid);
+
+		compare<size_t>(childBlock->size(), 1, "Child allocation not recorded");
+		assert((uintptr_t) block != (*childBlock)[0], "Parent and child got the same block");
+	}
+}
+
+void Test_SharedArena_ProcessKilledWhileAllocating_OthersKeepAllocating()
+{
+	logtest(__func__);
+
+	// Large blocks skip the process cache, so every call takes the allocator lock
+	constexpr size_t LARGE_BLOCK = 64 * 1024;
+	SharedArena arena(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+
+	for (int round = 0; round < 20; ++round)
+	{
+		TestBarrier barrier;
+		pid_t childPid = fork();
+		assert(childPid >= 0, "Process fork failed");
+		barrier.Forked(childPid);
+
+		if (childPid == 0)
+		{
+			/*
+			* Child Process -- don't do assertions here!
+			*/
+			barrier.Arrive();
+			for (;;)
+				arena.Deallocate(arena.Allocate(LARGE_BLOCK));
+		}
+
+		barrier.Arrive(); // Child is allocating
+		usleep(500 + round * 50);
+		StopChild(childPid);
+	}
+
+	// Hangs until the test timeout if the lock of a killed child is never taken over
+	void *block = arena.Allocate(LARGE_BLOCK);
+	arena.Deallocate(block);
+
+	assert(block != nullptr, "Allocation after killed allocators failed");
+}
+
+void Test_SharedArena_RecreatedUnderSameName_GrowsItsOwnFile()
+{
+	logtest(__func__);
+
+	SharedArena arena(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+	{
+		SharedArena deleter(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+		deleter.Delete();
+	}
+	// A new arena at the full reserve now owns the name
+	SharedArena recreated(ARENA_NAME_1, ARENA_RESERVE_1, ARENA_RESERVE_1);
+
+	// Crashes with SIGBUS if growing looked at the new file instead of the mapped one
+	std::vector<char*> blocks;
+	for (int i = 0; i < 100; ++i)
+	{
+		blocks.push_back(static_cast<char*>(arena.Allocate(10000)));
+		memset(blocks.back(), 'a', 10000);
+	}
+	const size_t recreatedCapacity = recreated.Capacity();
+	recreated.Delete();
+
+	assert(blocks.back() != nullptr, "Allocation after growing failed");
+	assert(arena.Capacity() > ARENA_SIZE_1 && arena.Capacity() < ARENA_RESERVE_1, "Arena should grow its own file step by step");
+	compare<size_t>(recreatedCapacity, ARENA_RESERVE_1, "New arena under the same name was changed");
+}
+
+void Test_SharedArena_ProcessKilledWhileAttaching_OthersAttach()
+{
+	logtest(__func__);
+
+	SharedArena arena(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		SharedRegion region(ARENA_NAME_1);
+		region.Create();
+		FutexLock(region.Get()->lifecycle, -1);
+		barrier.Arrive();
+		ExitChild(); // Exits holding the lifecycle lock
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		barrier.Arrive(); // Child holds the lifecycle lock
+		StopChild(childPid);
+
+		const auto start = std::chrono::steady_clock::now();
+		bool attached = false;
+		void *block = nullptr;
+		{
+			SharedArena other(ARENA_NAME_1, ARENA_SIZE_1, ARENA_RESERVE_1);
+			attached = other.IsCreated();
+			block = other.Allocate(100);
+		}
+		const auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+		assert(attached, "Arena should attach after the lock holder died");
+		assert(block != nullptr, "Allocation after the lock holder died failed");
+		assert(waited < WAIT_TIME_2, "Lock of the dead process should be taken over quickly");
+	}
+}
+
+//====================================================================================================
+//====================================================================================================
+
+static std::vector<TestCase> GetSharedArenaTests()
+{
+	return std::vector<TestCase> {
+		TEST_CASE(Test_SharedArena_Deallocate_BlockReused),
+		TEST_CASE(Test_SharedArena_AllocateBeyondSize_ArenaGrows),
+		TEST_CASE(Test_SharedArena_Containers_StoreAndFind),
+		TEST_CASE(Test_SharedArena_TwoProcesses_ShareContainersWithoutCopy),
+		TEST_CASE(Test_SharedArena_Fork_CacheNotShared),
+		TEST_CASE(Test_SharedArena_ProcessKilledWhileAllocating_OthersKeepAllocating),
+		TEST_CASE(Test_SharedArena_RecreatedUnderSameName_GrowsItsOwnFile),
+		TEST_CASE(Test_SharedArena_ProcessKilledWhileAttaching_OthersAttach),
+	};
+}
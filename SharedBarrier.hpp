@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include "SharedRegion.hpp"
+#include "SharedLifecycle.hpp"
+#include "SharedFutex.hpp"
+
+constexpr unsigned int SHARED_BARRIER_PARTICIPANTS = 256;  /* Instances that can take part at once */
+
+enum class BarrierStatus { Passed, TimedOut, ParticipantLost };
+
+/*
+* One instance taking part in a barrier or latch
+*/
+struct shared_barrier_participant {
+	pid_t    pid;       // 0 when the slot is free
+	uint32_t arrived;   // Barrier: generation + 1 it last arrived in. Latch: 1 once it counted down
+};
+
+/*
+* These structs are what is mapped to memory.
+* Bookkeeping is done under the lock word, waiting is done on the futex word.
+*/
+struct shared_barrier_layout {
+	shared_region_layout       header;
+	std::atomic<uint32_t>      lock;          // Bookkeeping lock, see FutexLock()
+	uint32_t                   requested;     // Participants the first process asked for
+	uint32_t                   participants;  // Arrivals that complete a phase, less while some left
+	uint32_t                   arrived;       // Arrivals in the current phase
+	std::atomic<uint32_t>      generation;    // Completed phases. The futex word
+	std::atomic<uint32_t>      lost;          // Participants that died or left before arriving
+	shared_barrier_participant slots[SHARED_BARRIER_PARTICIPANTS];
+};
+
+struct shared_latch_layout {
+	shared_region_layout       header;
+	std::atomic<uint32_t>      lock;          // Bookkeeping lock, see FutexLock()
+	std::atomic<uint32_t>      count;         // Count downs missing. The futex word
+	std::atomic<uint32_t>      lost;          // Participants that died or left before counting down
+	shared_barrier_participant slots[SHARED_BARRIER_PARTICIPANTS];
+};
+
+/*
+* Claims a participant slot, needs the lock
+*/
+inline int ClaimBarrierSlot(shared_barrier_participant (&slots)[SHARED_BARRIER_PARTICIPANTS])
+{
+	for (unsigned int slot = 0; slot < SHARED_BARRIER_PARTICIPANTS; ++slot)
+	{
+		if (slots[slot].pid == 0)
+		{
+			slots[slot].pid = getpid();
+			slots[slot].arrived = 0;
+			return (int) slot;
+		}
+	}
+	return -1;
+}
+
+
+/*
+* - Named reusable barrier. Every instance is one participant. A phase ends
+*   when as many participants arrived as the first process asked for, then
+*   all waiters are released at once and the next phase begins
+* - Waiters sleep on a futex holding the generation, i.e. the number of
+*   completed phases. Completing a phase is one increment and one wake-up
+* - A participant whose process died before arriving is noticed by the
+*   waiters within SHARED_LOCK_POLL_TIME. It is dropped, the phase completes
+*   without it and LastStatus() reports BarrierStatus::ParticipantLost.
+*   Releasing an instance leaves the barrier the same way. A new instance
+*   joining later takes its place again, up to the count first asked for
+* - A timed out ArriveAndWait() takes its arrival back
+* - Follows the refcount/timestamp lifecycle of LinuxSharedMutex
+*/
+class LinuxSharedBarrier
+{
+private:
+	const std::string             _name;
+	std::unique_ptr<SharedRegion> _share;
+	int                           _slot;
+	BarrierStatus                 _status;
+
+public:
+	LinuxSharedBarrier(const char *name, unsigned int participants)
+		: _name(name), _share(new SharedRegion(name, sizeof(shared_barrier_layout))), _slot(-1), _status(BarrierStatus::Passed)
+	{
+		if (!AttachSharedRegion(*_share, [this, participants] { Layout()->requested = Layout()->participants = participants; }))
+			return;
+
+		auto layout = Layout();
+		SharedFutexGuard guard(layout->lock);
+		_slot = ClaimBarrierSlot(layout->slots);
+		if (_slot >= 0)
+			Rejoin();
+	}
+
+	virtual ~LinuxSharedBarrier()
+	{
+		this->Release();
+	}
+
+	virtual std::string_view Name() const { return _name; }
+	virtual BarrierStatus LastStatus() const { return _status; }
+
+	virtual unsigned int Generation() const
+	{
+		return Layout() ? Layout()->generation.load(std::memory_order_acquire) : 0;
+	}
+
+	// Returns false when the phase did not complete in time. A timeout below 0 waits forever
+	virtual bool ArriveAndWait(int timeout)
+	{
+		auto layout = Layout();
+		_status = BarrierStatus::TimedOut;
+		if (layout == nullptr || _slot < 0)
+			return false;
+
+		uint32_t generation, lost;
+		{
+			SharedFutexGuard guard(layout->lock);
+			generation = layout->generation.load(std::memory_order_relaxed);
+			lost = layout->lost.load(std::memory_order_relaxed);
+			layout->slots[_slot].arrived = generation + 1;
+			if (++layout->arrived >= layout->participants)
+			{
+				CompletePhase();
+				_status = BarrierStatus::Passed;
+				return true;
+			}
+		}
+
+		const long deadline = FutexMillisecondsNow() + timeout;
+		while (layout->generation.load(std::memory_order_acquire) == generation)
+		{
+			const long remaining = timeout < 0 ? SHARED_LOCK_POLL_TIME : deadline - FutexMillisecondsNow();
+			if (remaining <= 0)
+			{
+				SharedFutexGuard guard(layout->lock);
+				if (layout->generation.load(std::memory_order_relaxed) != generation)
+					break;
+				layout->arrived--;
+				layout->slots[_slot].arrived = 0;
+				return false;
+			}
+
+			FutexWait(layout->generation, generation, std::min(remaining, SHARED_LOCK_POLL_TIME));
+			DropDeadParticipants();
+		}
+
+		_status = layout->lost.load(std::memory_order_relaxed) != lost ? BarrierStatus::ParticipantLost : BarrierStatus::Passed;
+		return true;
+	}
+
+	virtual void Release()
+	{
+		auto layout = Layout();
+		if (layout == nullptr)
+			return;
+
+		if (_slot >= 0)
+		{
+			SharedFutexGuard guard(layout->lock);
+			Drop(_slot);
+			_slot = -1;
+		}
+		DetachSharedRegion(*_share);
+	}
+
+private:
+	shared_barrier_layout* Layout() const
+	{
+		return _share->GetAs<shared_barrier_layout>();
+	}
+
+	// Needs the lock
+	void CompletePhase()
+	{
+		auto layout = Layout();
+		layout->arrived = 0;
+		layout->generation.fetch_add(1, std::memory_order_release);
+		FutexWake(layout->generation);
+	}
+
+	// Needs the lock. A newcomer takes the place of a participant that was dropped
+	void Rejoin()
+	{
+		auto layout = Layout();
+		uint32_t joined = 0;
+		for (auto &participant : layout->slots)
+			joined += participant.pid != 0 ? 1 : 0;
+		if (joined > layout->participants && layout->participants < layout->requested)
+			layout->participants++;
+	}
+
+	// Needs the lock
+	void Drop(int slot)
+	{
+		auto layout = Layout();
+		const bool arrived = layout->slots[slot].arrived == layout->generation.load(std::memory_order_relaxed) + 1;
+		layout->slots[slot].pid = 0;
+		if (layout->participants > 0)
+			layout->participants--;
+
+		if (arrived)
+			layout->arrived--;
+		else
+			layout->lost.fetch_add(1, std::memory_order_relaxed);
+
+		if (layout->arrived > 0 && layout->arrived >= layout->participants)
+			CompletePhase();
+	}
+
+	void DropDeadParticipants()
+	{
+		auto layout = Layout();
+		SharedFutexGuard guard(layout->lock);
+		const uint32_t generation = layout->generation.load(std::memory_order_relaxed);
+		for (unsigned int slot = 0; slot < SHARED_BARRIER_PARTICIPANTS; ++slot)
+		{
+			auto &participant = layout->slots[slot];
+			if (participant.pid != 0 && participant.arrived != generation + 1 && !IsProcessAlive(participant.pid))
+				Drop((int) slot);
+		}
+	}
+};
+
+
+/*
+* - Named single-use latch. Waiters are released at once when the count set
+*   by the first process has been counted down to 0
+* - By default every instance is a participant expected to count down. Pass
+*   participant = false for instances that only wait
+* - A participant whose process died before counting down is noticed by the
+*   waiters within SHARED_LOCK_POLL_TIME. Its count down is done for it and
+*   LastStatus() reports BarrierStatus::ParticipantLost. Releasing a
+*   participant that did not count down does the same
+* - Follows the refcount/timestamp lifecycle of LinuxSharedMutex
+*/
+class LinuxSharedLatch
+{
+private:
+	const std::string             _name;
+	std::unique_ptr<SharedRegion> _share;
+	int                           _slot;
+	BarrierStatus                 _status;
+
+public:
+	LinuxSharedLatch(const char *name, unsigned int count, bool participant = true)
+		: _name(name), _share(new SharedRegion(name, sizeof(shared_latch_layout))), _slot(-1), _status(BarrierStatus::Passed)
+	{
+		if (!AttachSharedRegion(*_share, [this, count] { Layout()->count = count; }))
+			return;
+
+		if (participant)
+		{
+			auto layout = Layout();
+			SharedFutexGuard guard(layout->lock);
+			_slot = ClaimBarrierSlot(layout->slots);
+		}
+	}
+
+	virtual ~LinuxSharedLatch()
+	{
+		this->Release();
+	}
+
+	virtual std::string_view Name() const { return _name; }
+	virtual BarrierStatus LastStatus() const { return _status; }
+
+	virtual void CountDown(unsigned int count = 1)
+	{
+		auto layout = Layout();
+		if (layout == nullptr)
+			return;
+
+		SharedFutexGuard guard(layout->lock);
+		if (_slot >= 0)
+			layout->slots[_slot].arrived = 1;
+		Decrease(count);
+	}
+
+	virtual bool TryWait() const
+	{
+		return Layout() && Layout()->count.load(std::memory_order_acquire) == 0;
+	}
+
+	// Returns false when the count did not reach 0 in time. A timeout below 0 waits forever
+	virtual bool Wait(int timeout)
+	{
+		auto layout = Layout();
+		_status = BarrierStatus::TimedOut;
+		if (layout == nullptr)
+			return false;
+
+		const long deadline = FutexMillisecondsNow() + timeout;
+		for (;;)
+		{
+			const uint32_t count = layout->count.load(std::memory_order_acquire);
+			if (count == 0)
+				break;
+
+			const long remaining = timeout < 0 ? SHARED_LOCK_POLL_TIME : deadline - FutexMillisecondsNow();
+			if (remaining <= 0)
+				return false;
+
+			FutexWait(layout->count, count, std::min(remaining, SHARED_LOCK_POLL_TIME));
+			CountDownForDeadParticipants();
+		}
+
+		_status = layout->lost.load(std::memory_order_relaxed) > 0 ? BarrierStatus::ParticipantLost : BarrierStatus::Passed;
+		return true;
+	}
+
+	virtual bool ArriveAndWait(int timeout)
+	{
+		this->CountDown();
+		return this->Wait(timeout);
+	}
+
+	virtual void Release()
+	{
+		auto layout = Layout();
+		if (layout == nullptr)
+			return;
+
+		if (_slot >= 0)
+		{
+			SharedFutexGuard guard(layout->lock);
+			Drop(_slot);
+			_slot = -1;
+		}
+		DetachSharedRegion(*_share);
+	}
+
+private:
+	shared_latch_layout* Layout() const
+	{
+		return _share->GetAs<shared_latch_layout>();
+	}
+
+	// Needs the lock
+	void Decrease(unsigned int count)
+	{
+		auto layout = Layout();
+		const uint32_t current = layout->count.load(std::memory_order_relaxed);
+		if (current == 0)
+			return;
+
+		layout->count.store(current - std::min(current, count), std::memory_order_release);
+		if (layout->count.load(std::memory_order_relaxed) == 0)
+			FutexWake(layout->count);
+	}
+
+	// Needs the lock
+	void Drop(int slot)
+	{
+		auto layout = Layout();
+		if (layout->slots[slot].arrived == 0)
+		{
+			layout->lost.fetch_add(1, std::memory_order_relaxed);
+			Decrease(1);
+		}
+		layout->slots[slot].pid = 0;
+	}
+
+	void CountDownForDeadParticipants()
+	{
+		auto layout = Layout();
+		SharedFutexGuard guard(layout->lock);
+		for (unsigned int slot = 0; slot < SHARED_BARRIER_PARTICIPANTS; ++slot)
+		{
+			auto &participant = layout->slots[slot];
+			if (participant.pid != 0 && participant.arrived == 0 && !IsProcessAlive(participant.pid))
+				Drop((int) slot);
+		}
+	}
+};
@@ -0,0 +1,226 @@
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include "SharedBarrier.hpp"
+#include "TestHelpers.h"
+
+constexpr TestName BARRIER_NAME_1 = "BARRIER_1";
+constexpr TestName LATCH_NAME_1   = "LATCH_1";
+
+constexpr int BARRIER_PHASES = 3;
+
+//====================================================================================================
+//====================================================================================================
+
+void Test_SharedBarrier_TwoProcesses_MoveThroughPhasesInLockstep()
+{
+	logtest(__func__);
+
+	// Phase counter of the child, outside of the library
+	auto childPhase = static_cast<std::atomic<int>*>(mmap(NULL, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+	assert(childPhase != MAP_FAILED, "Mapping the phase counter failed");
+	childPhase->store(0);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		LinuxSharedBarrier sharedBarrier(BARRIER_NAME_1, 2);
+		barrier.Arrive();
+		for (int phase = 0; phase < BARRIER_PHASES; ++phase)
+		{
+			childPhase->fetch_add(1);
+			sharedBarrier.ArriveAndWait(WAIT_TIME_2);
+		}
+		barrier.Arrive();
+		ExitChild();
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		LinuxSharedBarrier sharedBarrier(BARRIER_NAME_1, 2);
+		barrier.Arrive(); // Child joined
+		std::vector<int> seen;
+		bool passed = true;
+		for (int phase = 0; phase < BARRIER_PHASES; ++phase)
+		{
+			passed = sharedBarrier.ArriveAndWait(WAIT_TIME_2) && passed;
+			seen.push_back(childPhase->load());
+		}
+		barrier.Arrive();
+		StopChild(childPid);
+		munmap(childPhase, sizeof(std::atomic<int>));
+
+		assert(passed, "Barrier phases did not complete");
+		compare<unsigned int>(sharedBarrier.Generation(), BARRIER_PHASES, "Generation should count the phases");
+		for (int phase = 0; phase < BARRIER_PHASES; ++phase)
+			assert(seen[phase] >= phase + 1, "Parent left a phase the child had not reached");
+	}
+}
+
+void Test_SharedBarrier_MissingParticipant_TimesOutAndTakesArrivalBack()
+{
+	logtest(__func__);
+
+	LinuxSharedBarrier first(BARRIER_NAME_1, 2);
+	const bool passedAlone = first.ArriveAndWait(WAIT_TIME_1);
+	const BarrierStatus statusAlone = first.LastStatus();
+
+	bool passedLate = false;
+	std::thread late([&passedLate] {
+		LinuxSharedBarrier second(BARRIER_NAME_1, 2);
+		passedLate = second.ArriveAndWait(WAIT_TIME_2);
+	});
+	const bool passedTogether = first.ArriveAndWait(WAIT_TIME_2);
+	late.join();
+
+	assert(!passedAlone, "Barrier should not pass with one of two participants");
+	assert(statusAlone == BarrierStatus::TimedOut, "Status should be timed out");
+	assert(passedTogether && passedLate, "Barrier should pass once both arrived");
+	compare<unsigned int>(first.Generation(), 1, "Timed out arrival should not count towards the phase");
+}
+
+void Test_SharedBarrier_ParticipantLeftAndNewOneJoined_WaitsForNewcomer()
+{
+	logtest(__func__);
+
+	LinuxSharedBarrier first(BARRIER_NAME_1, 2);
+	{
+		LinuxSharedBarrier leaving(BARRIER_NAME_1, 2);
+	}
+	LinuxSharedBarrier joining(BARRIER_NAME_1, 2);
+	const bool passedAlone = first.ArriveAndWait(WAIT_TIME_1);
+
+	bool passedNewcomer = false;
+	std::thread newcomer([&joining, &passedNewcomer] {
+		passedNewcomer = joining.ArriveAndWait(WAIT_TIME_2);
+	});
+	const bool passedTogether = first.ArriveAndWait(WAIT_TIME_2);
+	newcomer.join();
+
+	assert(!passedAlone, "Barrier should wait for the participant that joined");
+	assert(passedTogether && passedNewcomer, "Barrier should pass once both arrived");
+}
+
+void Test_SharedBarrier_ParticipantDied_PhaseCompletesWithoutIt()
+{
+	logtest(__func__);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		LinuxSharedBarrier sharedBarrier(BARRIER_NAME_1, 2);
+		barrier.Arrive();
+		ExitChild(); // Exits without arriving
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		LinuxSharedBarrier sharedBarrier(BARRIER_NAME_1, 2);
+		barrier.Arrive(); // Child joined
+		StopChild(childPid);
+		const bool passed = sharedBarrier.ArriveAndWait(WAIT_TIME_2);
+		const BarrierStatus status = sharedBarrier.LastStatus();
+		const bool passedNextPhase = sharedBarrier.ArriveAndWait(0);
+
+		assert(passed, "Phase should complete without the dead participant");
+		assert(status == BarrierStatus::ParticipantLost, "Status should report the lost participant");
+		assert(passedNextPhase, "Dead participant should not be waited for in later phases");
+	}
+}
+
+void Test_SharedLatch_CountedDown_ReleasesWaiters()
+{
+	logtest(__func__);
+
+	LinuxSharedLatch waiter(LATCH_NAME_1, 2, false);
+	const bool readyBefore = waiter.TryWait();
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < 2; ++i)
+	{
+		workers.emplace_back([] {
+			LinuxSharedLatch latch(LATCH_NAME_1, 2);
+			latch.CountDown();
+		});
+	}
+	const bool passed = waiter.Wait(WAIT_TIME_2);
+	for (auto &worker : workers)
+		worker.join();
+
+	assert(!readyBefore, "Latch should not be ready before counting down");
+	assert(passed, "Latch should release the waiter after counting down");
+	assert(waiter.LastStatus() == BarrierStatus::Passed, "Status should be passed");
+	assert(waiter.TryWait(), "Latch should stay released");
+}
+
+void Test_SharedLatch_ParticipantDied_WaiterReleased()
+{
+	logtest(__func__);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		LinuxSharedLatch latch(LATCH_NAME_1, 1);
+		barrier.Arrive();
+		ExitChild(); // Exits without counting down
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		LinuxSharedLatch latch(LATCH_NAME_1, 1, false);
+		barrier.Arrive(); // Child joined
+		const bool passedWhileAlive = latch.Wait(WAIT_TIME_1);
+		StopChild(childPid);
+		const bool passed = latch.Wait(WAIT_TIME_2);
+
+		assert(!passedWhileAlive, "Latch should wait for a live participant");
+		assert(passed, "Latch should not wait for a dead participant");
+		assert(latch.LastStatus() == BarrierStatus::ParticipantLost, "Status should report the lost participant");
+	}
+}
+
+//====================================================================================================
+//====================================================================================================
+
+static std::vector<TestCase> GetSharedBarrierTests()
+{
+	return std::vector<TestCase> {
+		TEST_CASE(Test_SharedBarrier_TwoProcesses_MoveThroughPhasesInLockstep),
+		TEST_CASE(Test_SharedBarrier_MissingParticipant_TimesOutAndTakesArrivalBack),
+		TEST_CASE(Test_SharedBarrier_ParticipantDied_PhaseCompletesWithoutIt),
+		TEST_CASE(Test_SharedBarrier_ParticipantLeftAndNewOneJoined_WaitsForNewcomer),
+		TEST_CASE(Test_SharedLatch_CountedDown_ReleasesWaiters),
+		TEST_CASE(Test_SharedLatch_ParticipantDied_WaiterReleased),
+	};
+}
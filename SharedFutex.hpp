@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+	"Futex words must be plain lock-free 32-bit atomics");
+
+constexpr long     SHARED_LOCK_POLL_TIME = 100;         /* Milliseconds between checks for a dead owner */
+constexpr uint32_t SHARED_LOCK_WAITERS   = 0x80000000;  /* Set in a lock word while others wait for it */
+
+/*
+* Blocking on a 32-bit word in shared memory, woken from any process.
+* - Unlike a std::mutex in shared memory, waiting in the kernel is fine here:
+*   the futexes are not process-private, so a wake from another process
+*   reaches the waiter
+* - FutexWait() returns when woken, on timeout, on a signal, or right away
+*   when the word no longer holds the expected value. Callers re-check their
+*   condition in a loop
+*/
+inline void FutexWait(std::atomic<uint32_t> &word, uint32_t expected, long timeout)
+{
+	struct timespec relative;
+	relative.tv_sec = timeout / 1000;
+	relative.tv_nsec = (timeout % 1000) * 1000000;
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, timeout < 0 ? nullptr : &relative, nullptr, 0);
+}
+
+inline void FutexWake(std::atomic<uint32_t> &word, int count = INT_MAX)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+// Milliseconds on the monotonic clock, for timeouts
+inline long FutexMillisecondsNow()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// A process that ended without releasing a futex word can be waited for forever
+inline bool IsProcessAlive(pid_t pid)
+{
+	return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+/*
+* Mutex on a futex word holding the owner's pid | SHARED_LOCK_WAITERS, 0 when free.
+* - Unlike std::mutex, it survives its owner: a waiter takes over the lock of
+*   a process that died holding it within SHARED_LOCK_POLL_TIME. The pid is
+*   part of the word that is swapped, so only the lock of the process found
+*   dead can be taken over. What it guarded may be left half updated
+* - Threads of one process exclude each other as well, but the word does not
+*   tell them apart. Callers that need the owning thread keep it themselves
+* - A timeout below 0 waits forever
+*/
+inline bool FutexLock(std::atomic<uint32_t> &word, long timeout)
+{
+	const uint32_t pid = (uint32_t) getpid();
+	uint32_t state = 0;
+	if (word.compare_exchange_strong(state, pid, std::memory_order_acquire))
+		return true;
+
+	// Others may be waiting as well once this one waited, so leave the flag set when taking it
+	const long deadline = FutexMillisecondsNow() + timeout;
+	for (;;)
+	{
+		state = word.load(std::memory_order_relaxed);
+		if (state == 0)
+		{
+			if (word.compare_exchange_weak(state, pid | SHARED_LOCK_WAITERS, std::memory_order_acquire))
+				return true;
+			continue;
+		}
+
+		const long remaining = timeout < 0 ? SHARED_LOCK_POLL_TIME : deadline - FutexMillisecondsNow();
+		if (remaining <= 0)
+			return false;
+		if ((state & SHARED_LOCK_WAITERS) == 0 &&
+			!word.compare_exchange_weak(state, state | SHARED_LOCK_WAITERS, std::memory_order_relaxed))
+			continue;
+		state |= SHARED_LOCK_WAITERS;
+		FutexWait(word, state, std::min(remaining, SHARED_LOCK_POLL_TIME));
+
+		// Take over the lock of a process that died holding it
+		const pid_t owner = (pid_t) (state & ~SHARED_LOCK_WAITERS);
+		if (word.load(std::memory_order_relaxed) == state && !IsProcessAlive(owner) &&
+			word.compare_exchange_strong(state, pid | SHARED_LOCK_WAITERS, std::memory_order_acquire))
+			return true;
+	}
+}
+
+inline void FutexUnlock(std::atomic<uint32_t> &word)
+{
+	if (word.exchange(0, std::memory_order_release) & SHARED_LOCK_WAITERS)
+		FutexWake(word, 1);
+}
+
+/*
+* Holds a FutexLock() for a short critical section in shared memory
+*/
+class SharedFutexGuard
+{
+private:
+	std::atomic<uint32_t>& _word;
+
+public:
+	SharedFutexGuard(std::atomic<uint32_t>& word) : _word(word) { FutexLock(_word, -1); }
+	virtual ~SharedFutexGuard() { FutexUnlock(_word); }
+};
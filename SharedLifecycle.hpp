@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include "SharedRegion.hpp"
+#include "SharedFutex.hpp"
+
+constexpr long SHARED_REGION_STALE_TIME = 30 * 60 * 1000;  /* Milliseconds before an unreleased region is recreated */
+
+inline long SharedRegionMillisecondsNow()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*
+* The refcount/timestamp lifecycle of LinuxSharedMutex, for primitives that map
+* their own layout (which must begin with a shared_region_layout).
+* - Attaching creates or opens the region. A region whose timestamp is older
+*   than staleTime and that nobody is attached to was most likely left behind
+*   by a crashed process, so it is deleted and created anew. A region still
+*   counting users is never recreated, that would split them from the new
+*   ones. A staleTime of 0 never treats a region as stale
+* - The first process to attach runs initialize() and sets the timestamp
+* - Detaching decreases the reference count, the last user deletes the region
+* - The counter and timestamp are guarded by the header's lifecycle word, a
+*   FutexLock(). A process killed while attaching or detaching does not
+*   block the others, they take its lock over
+*/
+inline bool AttachSharedRegion(SharedRegion &region, const std::function<void()> &initialize, long staleTime = SHARED_REGION_STALE_TIME)
+{
+	if (!region.Create())
+		return false;
+
+	auto header = region.Get();
+	if (staleTime > 0)
+	{
+		bool isStale = false;
+		{
+			SharedFutexGuard guard(header->lifecycle);
+			isStale = header->counter == 0 && header->timestamp != 0 &&
+				SharedRegionMillisecondsNow() - header->timestamp > staleTime;
+		}
+		if (isStale)
+		{
+			region.Destroy();
+			if (!region.Create())
+				return false;
+			header = region.Get();
+		}
+	}
+
+	SharedFutexGuard guard(header->lifecycle);
+	if (header->timestamp == 0)
+	{
+		if (initialize)
+			initialize();
+		header->timestamp = SharedRegionMillisecondsNow();
+	}
+	header->counter++;
+	return true;
+}
+
+inline void DetachSharedRegion(SharedRegion &region)
+{
+	auto header = region.Get();
+	if (header == nullptr)
+		return;
+
+	bool isLast = false;
+	{
+		SharedFutexGuard guard(header->lifecycle);
+		if (header->counter > 0)
+			header->counter--;
+		isLast = header->counter == 0;
+	}
+
+	if (isLast)
+		region.Destroy();
+	else
+		region.Unmap();
+}
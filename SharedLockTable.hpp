@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "SharedRegion.hpp"
+#include "SharedLifecycle.hpp"
+#include "SharedFutex.hpp"
+#include "ForkGeneration.hpp"
+
+constexpr unsigned int SHARED_LOCK_TABLE_STRIPES = 4096;  /* Default number of stripes */
+constexpr size_t       SHARED_LOCK_TABLE_LINE    = 64;    /* Cache line, one stripe each */
+
+/*
+* One lock of the table, alone on its cache line so neighbouring stripes
+* taken by different processes do not slow each other down.
+*/
+struct alignas(SHARED_LOCK_TABLE_LINE) shared_lock_stripe {
+	std::atomic<uint32_t> state;   // FutexLock() word: owner pid | SHARED_LOCK_WAITERS, 0 when free
+	std::atomic<pid_t>    tid;     // Owner thread, for Unlock()
+};
+
+/*
+* This struct is what is mapped to memory, the stripes follow it.
+*/
+struct shared_lock_table_layout {
+	shared_region_layout header;
+	uint32_t             stripeCount;   // Power of two, set by the first process
+};
+
+/*
+* - Per-key mutual exclusion across processes for any number of keys, in one
+*   named shared region with a fixed number of lock stripes. Keys are hashed
+*   to stripes, so memory does not depend on the number of keys
+* - Keys are strings or integers. Their hash is stable across processes and
+*   builds: FNV-1a for strings, a 64-bit mix for integers
+* - Different keys can share a stripe and then exclude each other. A thread
+*   must not hold two keys through separate Lock() calls, they may be the same
+*   stripe. TryLockAll() takes several keys at once: it locks every stripe
+*   once and in ascending order, so it cannot deadlock against other callers
+* - Waiters block on a futex. A stripe whose owner process died is taken over
+*   by the next waiter within SHARED_LOCK_POLL_TIME
+* - Follows the lifecycle of LinuxSharedMutex except for the stale timestamp:
+*   recreating the table under processes holding stripes would break mutual
+*   exclusion, and stripes of dead owners are recovered anyway
+*/
+class SharedLockTable
+{
+private:
+	const std::string             _name;
+	std::unique_ptr<SharedRegion> _share;
+	uint32_t                      _stripeCount;
+
+public:
+	SharedLockTable(const char *name, unsigned int stripes = SHARED_LOCK_TABLE_STRIPES)
+		: _name(name), _stripeCount(RoundToPowerOfTwo(stripes))
+	{
+		_share.reset(new SharedRegion(name, StripesOffset() + _stripeCount * sizeof(shared_lock_stripe)));
+		AttachSharedRegion(*_share, [this] {
+			Layout()->stripeCount = _stripeCount;
+		}, 0);
+
+		// The first process chose the stripe count
+		if (Layout() != nullptr)
+			_stripeCount = Layout()->stripeCount;
+		ForkGeneration(); // Install the fork handler
+	}
+
+	virtual ~SharedLockTable()
+	{
+		this->Release();
+	}
+
+	const std::string& Name() const { return _name; }
+	unsigned int Stripes() const { return _stripeCount; }
+
+	static uint64_t Hash(std::string_view key)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : key)
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static uint64_t Hash(uint64_t key)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdull;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ull;
+		key ^= key >> 33;
+		return key;
+	}
+
+	template <typename Key>
+	unsigned int StripeOf(const Key &key) const
+	{
+		return (unsigned int) (Hash(key) & (_stripeCount - 1));
+	}
+
+	void Lock(std::string_view key) { AcquireStripe(StripeOf(key), -1); }
+	void Lock(uint64_t key) { AcquireStripe(StripeOf(key), -1); }
+
+	bool TryLock(std::string_view key, int timeout) { return AcquireStripe(StripeOf(key), timeout); }
+	bool TryLock(uint64_t key, int timeout) { return AcquireStripe(StripeOf(key), timeout); }
+
+	// Only unlocks a stripe held by the calling thread
+	void Unlock(std::string_view key) { ReleaseStripe(StripeOf(key)); }
+	void Unlock(uint64_t key) { ReleaseStripe(StripeOf(key)); }
+
+	// Locks all keys or none of them
+	template <typename Keys>
+	bool TryLockAll(const Keys &keys, int timeout)
+	{
+		auto stripes = SortedStripes(keys);
+		const long deadline = FutexMillisecondsNow() + timeout;
+		for (size_t i = 0; i < stripes.size(); ++i)
+		{
+			const long remaining = timeout < 0 ? -1 : std::max(0L, deadline - FutexMillisecondsNow());
+			if (!AcquireStripe(stripes[i], remaining))
+			{
+				while (i > 0)
+					ReleaseStripe(stripes[--i]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template <typename Keys>
+	void UnlockAll(const Keys &keys)
+	{
+		auto stripes = SortedStripes(keys);
+		for (auto stripe = stripes.rbegin(); stripe != stripes.rend(); ++stripe)
+			ReleaseStripe(*stripe);
+	}
+
+	void Release()
+	{
+		DetachSharedRegion(*_share);
+	}
+
+	void Delete()
+	{
+		_share->Destroy();
+	}
+
+private:
+	shared_lock_table_layout* Layout() const
+	{
+		return _share->GetAs<shared_lock_table_layout>();
+	}
+
+	shared_lock_stripe* Stripe(unsigned int stripe) const
+	{
+		auto layout = Layout();
+		if (layout == nullptr)
+			return nullptr;
+		return reinterpret_cast<shared_lock_stripe*>(reinterpret_cast<char*>(layout) + StripesOffset()) + stripe;
+	}
+
+	// A timeout below 0 waits forever
+	bool AcquireStripe(unsigned int index, long timeout)
+	{
+		auto stripe = Stripe(index);
+		if (stripe == nullptr)
+			return false;
+
+		if (!FutexLock(stripe->state, timeout))
+			return false;
+		stripe->tid.store(ThisThreadId(), std::memory_order_relaxed);
+		return true;
+	}
+
+	void ReleaseStripe(unsigned int index)
+	{
+		auto stripe = Stripe(index);
+		if (stripe == nullptr)
+			return;
+
+		const uint32_t state = stripe->state.load(std::memory_order_relaxed);
+		if ((state & ~SHARED_LOCK_WAITERS) != (uint32_t) getpid() || stripe->tid.load(std::memory_order_relaxed) != ThisThreadId())
+			return;
+
+		stripe->tid.store(0, std::memory_order_relaxed);
+		FutexUnlock(stripe->state);
+	}
+
+	template <typename Keys>
+	std::vector<unsigned int> SortedStripes(const Keys &keys) const
+	{
+		std::vector<unsigned int> stripes;
+		for (auto &key : keys)
+			stripes.push_back(StripeOf(key));
+		std::sort(stripes.begin(), stripes.end());
+		stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+		return stripes;
+	}
+
+	static pid_t ThisThreadId()
+	{
+		// A forked child's thread has a new id
+		thread_local pid_t tid = 0;
+		thread_local unsigned int generation = 0;
+		if (tid == 0 || generation != ForkGenerationCounter())
+		{
+			tid = (pid_t) syscall(SYS_gettid);
+			generation = ForkGenerationCounter();
+		}
+		return tid;
+	}
+
+	static constexpr size_t StripesOffset()
+	{
+		return (sizeof(shared_lock_table_layout) + SHARED_LOCK_TABLE_LINE - 1) & ~(SHARED_LOCK_TABLE_LINE - 1);
+	}
+
+	static uint32_t RoundToPowerOfTwo(unsigned int value)
+	{
+		uint32_t rounded = 1;
+		while (rounded < value && rounded < (1u << 30))
+			rounded <<= 1;
+		return rounded;
+	}
+};
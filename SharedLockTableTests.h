@@ -0,0 +1,200 @@
+#include <vector>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <signal.h>
+#include "SharedLockTable.hpp"
+#include "TestHelpers.h"
+
+constexpr TestName LOCK_TABLE_NAME_1 = "LOCK_TABLE_1";
+
+// Finds a key that hashes to another stripe than the given one
+static uint64_t KeyOnOtherStripe(const SharedLockTable &table, uint64_t key)
+{
+	uint64_t other = key + 1;
+	while (table.StripeOf(other) == table.StripeOf(key))
+		++other;
+	return other;
+}
+
+//====================================================================================================
+//====================================================================================================
+
+void Test_SharedLockTable_Hash_StableAndStriped()
+{
+	logtest(__func__);
+
+	SharedLockTable table(LOCK_TABLE_NAME_1, 1000);
+	SharedLockTable sameTable(LOCK_TABLE_NAME_1, 16);
+
+	compare<unsigned int>(table.Stripes(), 1024, "Stripe count not rounded to a power of two");
+	compare<unsigned int>(sameTable.Stripes(), 1024, "Stripe count should be set by the first process");
+	compare<uint64_t>(SharedLockTable::Hash("a"), 0xaf63dc4c8601ec8cull, "String hash is not FNV-1a");
+	compare<unsigned int>(sameTable.StripeOf("/var/data/file"), table.StripeOf(std::string("/var/data/file")), "Same key should map to the same stripe");
+}
+
+void Test_SharedLockTable_KeyLockedInOtherProcess_TryLockFailsOnlyForThatStripe()
+{
+	logtest(__func__);
+
+	SharedLockTable table(LOCK_TABLE_NAME_1);
+	const uint64_t key = 42;
+	const uint64_t otherKey = KeyOnOtherStripe(table, key);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		SharedLockTable childTable(LOCK_TABLE_NAME_1);
+		childTable.Lock(key);
+		barrier.Arrive();
+		barrier.Arrive(); // Parent tried the keys
+		childTable.Unlock(key);
+		barrier.Arrive();
+		ExitChild();
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		barrier.Arrive(); // Child holds the key
+		const bool lockedKey = table.TryLock(key, WAIT_TIME_1);
+		const bool lockedOtherKey = table.TryLock(otherKey, 0);
+		table.Unlock(otherKey);
+		barrier.Arrive();
+		barrier.Arrive(); // Child unlocked
+		const bool lockedAfterUnlock = table.TryLock(key, 0);
+		table.Unlock(key);
+		StopChild(childPid);
+
+		assert(!lockedKey, "Key held by another process should not be lockable");
+		assert(lockedOtherKey, "Key on another stripe should be lockable");
+		assert(lockedAfterUnlock, "Key should be lockable after the other process unlocked it");
+	}
+}
+
+void Test_SharedLockTable_Threads_MutualExclusion()
+{
+	logtest(__func__);
+
+	SharedLockTable table(LOCK_TABLE_NAME_1, 4);
+	int counters[2] = { 0, 0 };
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t)
+	{
+		threads.emplace_back([&table, &counters] {
+			for (int i = 0; i < 10000; ++i)
+			{
+				const uint64_t key = (uint64_t) (i % 2);
+				table.Lock(key);
+				counters[key]++;
+				table.Unlock(key);
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+
+	compare<int>(counters[0] + counters[1], 40000, "Increments lost under the stripe locks");
+}
+
+void Test_SharedLockTable_LockAll_SameStripeTwice_NoSelfDeadlock()
+{
+	logtest(__func__);
+
+	SharedLockTable table(LOCK_TABLE_NAME_1, 1);
+	const std::vector<std::string> keys { "account/1", "account/2", "account/3" };
+
+	const bool locked = table.TryLockAll(keys, WAIT_TIME_1);
+	bool lockedInThread = true;
+	std::thread([&] { lockedInThread = table.TryLock("account/4", 0); }).join();
+	table.UnlockAll(keys);
+	bool lockedAfterUnlock = false;
+	std::thread([&] {
+		lockedAfterUnlock = table.TryLock("account/4", 0);
+		table.Unlock("account/4");
+	}).join();
+
+	assert(locked, "Keys on the same stripe should lock once");
+	assert(!lockedInThread, "Stripe should be held by the first thread");
+	assert(lockedAfterUnlock, "UnlockAll should release the stripe");
+}
+
+void Test_SharedLockTable_OwnerDied_WaiterTakesOver()
+{
+	logtest(__func__);
+
+	SharedLockTable table(LOCK_TABLE_NAME_1);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		SharedLockTable childTable(LOCK_TABLE_NAME_1);
+		childTable.Lock("file");
+		barrier.Arrive();
+		ExitChild(); // Exits holding the key
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		barrier.Arrive();
+		StopChild(childPid);
+		const bool locked = table.TryLock("file", WAIT_TIME_2);
+		table.Unlock("file");
+
+		assert(locked, "Key of a dead process should be taken over");
+	}
+}
+
+void Test_SharedLockTable_OldTimestamp_NotRecreatedUnderItsUsers()
+{
+	logtest(__func__);
+
+	SharedLockTable holder(LOCK_TABLE_NAME_1);
+	holder.Lock("key");
+
+	// Age the table far beyond SHARED_REGION_STALE_TIME
+	SharedRegion region(LOCK_TABLE_NAME_1);
+	region.Create();
+	region.Get()->timestamp = 1;
+
+	SharedLockTable late(LOCK_TABLE_NAME_1);
+	const bool lockedByLate = late.TryLock("key", 0);
+	holder.Unlock("key");
+	const bool lockedAfterUnlock = late.TryLock("key", 0);
+	late.Unlock("key");
+
+	assert(!lockedByLate, "Old table was recreated while a stripe was held");
+	assert(lockedAfterUnlock, "Late instance should share the stripes of the old table");
+}
+
+//====================================================================================================
+//====================================================================================================
+
+static std::vector<TestCase> GetSharedLockTableTests()
+{
+	return std::vector<TestCase> {
+		TEST_CASE(Test_SharedLockTable_Hash_StableAndStriped),
+		TEST_CASE(Test_SharedLockTable_KeyLockedInOtherProcess_TryLockFailsOnlyForThatStripe),
+		TEST_CASE(Test_SharedLockTable_Threads_MutualExclusion),
+		TEST_CASE(Test_SharedLockTable_LockAll_SameStripeTwice_NoSelfDeadlock),
+		TEST_CASE(Test_SharedLockTable_OwnerDied_WaiterTakesOver),
+		TEST_CASE(Test_SharedLockTable_OldTimestamp_NotRecreatedUnderItsUsers),
+	};
+}
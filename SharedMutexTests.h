@@ -22,9 +22,6 @@ public:
 			Mutex->Release();
 	 }
 
-	void WaitOne() const { SleepFor(WAIT_TIME_1); }
-	void WaitTwo() const { SleepFor(WAIT_TIME_2); }
-
 	bool CreateSharedMutex() {
 		Mutex.reset(new LinuxSharedMutex(this->_name.c_str()));
 		return true;
@@ -194,8 +191,10 @@ void Test_TwoMutexes_LockFirst_SecondFails_TillFirstRelease()
 {
 	logtest(__func__);
 
+	TestBarrier barrier;
 	pid_t childPid = fork();
 	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
 
 	if (childPid == 0)
 	{
@@ -205,11 +204,11 @@ void Test_TwoMutexes_LockFirst_SecondFails_TillFirstRelease()
 		SharedMutexTest test(SHARE_NAME_1);
 		test.CreateSharedMutex();
 		test.GetMutex()->TryLock(0);
-		test.WaitTwo();
+		barrier.Arrive(); // Locked
+		barrier.Arrive(); // Parent tried
 		test.GetMutex()->Release();
-
-		// Don't proceed till killed by parent
-		while(1) SleepFor(CHILD_SLEEP_TIME);
+		barrier.Arrive(); // Released
+		ExitChild();
 	}
 	else
 	{
@@ -218,14 +217,15 @@ void Test_TwoMutexes_LockFirst_SecondFails_TillFirstRelease()
 		*/
 		SharedMutexTest test(SHARE_NAME_1);
 		test.CreateSharedMutex();
-		test.WaitOne();
+		barrier.Arrive();
 		auto lockFirst = test.GetMutex()->TryLock(0);
-		test.WaitOne();
+		barrier.Arrive();
+		barrier.Arrive();
 		auto lockSecond = test.GetMutex()->TryLock(0);
 		test.GetMutex()->Release();
 
-		// Kill child proc
-		kill(childPid, SIGTERM);
+		// Stop child proc
+		StopChild(childPid);
 
 		assert(lockFirst == false, "Shared mutex should be locked");
 		assert(lockSecond, "Shared mutex after release should be unlocked");
@@ -236,8 +236,10 @@ void Test_TwoMutexes_LockFirstForShortPeriod_TryLockSecond_SucceedsBeforeTimeout
 {
 	logtest(__func__);
 
+	TestBarrier barrier;
 	pid_t childPid = fork();
 	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
 
 	if (childPid == 0)
 	{
@@ -247,11 +249,10 @@ void Test_TwoMutexes_LockFirstForShortPeriod_TryLockSecond_SucceedsBeforeTimeout
 		SharedMutexTest test(SHARE_NAME_1);
 		test.CreateSharedMutex();
 		test.GetMutex()->TryLock(0);
-		test.WaitTwo();
+		barrier.Arrive(); // Locked
+		SleepFor(WAIT_TIME_1);
 		test.GetMutex()->Release();
-
-		// Don't proceed till killed by parent
-		while(1) SleepFor(CHILD_SLEEP_TIME);
+		ExitChild();
 	}
 	else
 	{
@@ -259,14 +260,13 @@ void Test_TwoMutexes_LockFirstForShortPeriod_TryLockSecond_SucceedsBeforeTimeout
 		* Parent Process -- assert only after child process stopped!
 		*/
 		SharedMutexTest test(SHARE_NAME_1);
-		test.WaitOne();
+		barrier.Arrive();
 		test.CreateSharedMutex();
 		auto success = test.GetMutex()->TryLock(WAIT_TIME_2);
-		test.WaitTwo();
 		test.GetMutex()->Release();
 
-		// Kill child proc
-		kill(childPid, SIGTERM);
+		// Stop child proc
+		StopChild(childPid);
 		
 		assert(success, "Mutex could not lock before timeout");
 	}
@@ -276,8 +276,10 @@ void Test_TwoMutexes_LockFirstForLongPeriod_TryLockSecond_FailsAfterTimeout()
 {
 	logtest(__func__);
 
+	TestBarrier barrier;
 	pid_t childPid = fork();
 	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
 
 	if (childPid == 0)
 	{
@@ -287,12 +289,10 @@ void Test_TwoMutexes_LockFirstForLongPeriod_TryLockSecond_FailsAfterTimeout()
 		SharedMutexTest test(SHARE_NAME_1);
 		test.CreateSharedMutex();
 		test.GetMutex()->TryLock(0);
-		test.WaitTwo();
-		test.WaitTwo();
+		barrier.Arrive(); // Locked
+		barrier.Arrive(); // Parent timed out
 		test.GetMutex()->Release();
-
-		// Don't proceed till killed by parent
-		while (1) SleepFor(CHILD_SLEEP_TIME);
+		ExitChild();
 	}
 	else
 	{
@@ -300,15 +300,14 @@ void Test_TwoMutexes_LockFirstForLongPeriod_TryLockSecond_FailsAfterTimeout()
 		 * Parent Process -- assert only after child process stopped!
 		 */
 		SharedMutexTest test(SHARE_NAME_1);
-		test.WaitOne();
+		barrier.Arrive();
 		test.CreateSharedMutex();
 		auto success = test.GetMutex()->TryLock(WAIT_TIME_1);
-		test.WaitTwo();
-		test.WaitTwo();
+		barrier.Arrive();
 		test.GetMutex()->Release();
 
-		// Kill child proc
-		kill(childPid, SIGTERM);
+		// Stop child proc
+		StopChild(childPid);
 
 		assert(success == false, "Mutex lock should timeout");
 	}
@@ -317,31 +316,17 @@ void Test_TwoMutexes_LockFirstForLongPeriod_TryLockSecond_FailsAfterTimeout()
 //====================================================================================================
 //====================================================================================================
 
-static std::vector<TEST_TYPE> GetSharedMutexTests() {
-	// Check no existing shared memory mapped files exist
-	SharedMutexTest test(SHARE_NAME_1);
-	if (test.HasFile())
-	{
-		std::cout
-			<< divider3 << std::endl
-			<< "!! ERROR !!" << std::endl
-			<< "Shared memory file already exists at /run/shm/" << SHARE_NAME_1 << std::endl
-			<< "Manually delete this file and re-run the tests" << std::endl
-			<< divider3 << std::endl;
-
-		return {};
-	}
-
-	return std::vector<TEST_TYPE> {
-		&Test_SingleMutex_Create_ValuesCorrect,
-		&Test_SingleMutex_Locking_Correct,
-		&Test_SingleMutex_CreateValidTimestamp_ReusesSharedRegion,
-		&Test_SingleMutex_CreateStaleTimestamp_CreatesNewShare,
-		&Test_SingleMutex_OnRelease_UnlocksMutex,
-		&Test_SingleMutex_OnRelease_DeletesShare,
-		&Test_SingleMutex_CounterIsTwo_OnRelease_DoesNotDeleteShare,
-		&Test_TwoMutexes_LockFirst_SecondFails_TillFirstRelease,
-		&Test_TwoMutexes_LockFirstForShortPeriod_TryLockSecond_SucceedsBeforeTimeout,
-		&Test_TwoMutexes_LockFirstForLongPeriod_TryLockSecond_FailsAfterTimeout,
+static std::vector<TestCase> GetSharedMutexTests() {
+	return std::vector<TestCase> {
+		TEST_CASE(Test_SingleMutex_Create_ValuesCorrect),
+		TEST_CASE(Test_SingleMutex_Locking_Correct),
+		TEST_CASE(Test_SingleMutex_CreateValidTimestamp_ReusesSharedRegion),
+		TEST_CASE(Test_SingleMutex_CreateStaleTimestamp_CreatesNewShare),
+		TEST_CASE(Test_SingleMutex_OnRelease_UnlocksMutex),
+		TEST_CASE(Test_SingleMutex_OnRelease_DeletesShare),
+		TEST_CASE(Test_SingleMutex_CounterIsTwo_OnRelease_DoesNotDeleteShare),
+		TEST_CASE(Test_TwoMutexes_LockFirst_SecondFails_TillFirstRelease),
+		TEST_CASE(Test_TwoMutexes_LockFirstForShortPeriod_TryLockSecond_SucceedsBeforeTimeout),
+		TEST_CASE(Test_TwoMutexes_LockFirstForLongPeriod_TryLockSecond_FailsAfterTimeout),
 	};
 }
\ No newline at end of file
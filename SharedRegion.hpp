@@ -1,8 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <utility>
 #include <string>
 #include <mutex>
+#include <thread>
+#include <chrono>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>   /* For mode constants */
@@ -17,9 +21,50 @@ struct shared_region_layout {
 	std::mutex mutex;       // Mutex lock
 	unsigned int counter;   // Counting concurrent usages
 	long timestamp;         // Timestamp when created
+	std::atomic<uint32_t> lifecycle;  // FutexLock() word guarding counter and timestamp, see SharedLifecycle.hpp
 };
 
 
+constexpr long SHARED_REGION_GUARD_TIMEOUT = 1000;  /* Milliseconds, far longer than any critical section under the guard */
+
+/*
+* Locks the mutex of a shared_region_layout for a short critical section.
+* - std::mutex is process-private: a lock() blocked in the kernel is not woken
+*   by an unlock() from another process, so only try_lock() is used here
+* - A std::mutex held by a process that died is never released. The guard
+*   gives up after the timeout instead of spinning forever, callers check
+*   IsLocked() and fail gracefully
+*/
+class SharedRegionGuard
+{
+private:
+	std::mutex& _mutex;
+	bool        _locked;
+
+public:
+	SharedRegionGuard(std::mutex& mutex, long timeout = SHARED_REGION_GUARD_TIMEOUT) : _mutex(mutex), _locked(false)
+	{
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		for (unsigned int attempt = 0; !(_locked = _mutex.try_lock()); ++attempt)
+		{
+			if (attempt < 100)
+				std::this_thread::yield();
+			else if (std::chrono::steady_clock::now() >= deadline)
+				break;
+			else
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+
+	virtual ~SharedRegionGuard()
+	{
+		if (_locked)
+			_mutex.unlock();
+	}
+
+	bool IsLocked() const { return _locked; }
+};
+
 /*
 * - This class manages named memory mapped files. It maps and allocates 
 *   shared_region_layout in the shared memory.
@@ -27,6 +72,15 @@ struct shared_region_layout {
 *   has to be done be the caller
 * - Each SharedRegion instance stores an allocation to the specified shared 
 *   memory region.
+* - By default the region is sized for shared_region_layout. Primitives with
+*   larger layouts pass their own size; such layouts must still begin with a
+*   shared_region_layout so the refcount/timestamp lifecycle applies to them
+* - An existing shared file is never shrunk when opened with a smaller size
+* - A growable region reserves a larger address range up front. Grow()
+*   extends the shared file inside that range, so the mapping never moves and
+*   other processes see the new bytes without remapping. It keeps its file
+*   open, so it always grows the file it mapped even if another process
+*   deleted it and created a new one under the same name
 * - On destruction, the allocated memory is unmapped and freed, however, 
 *   the underlying shared file is not deleted
 * - To cleanup the shared file, the caller has to call Destroy() explicitly
@@ -38,11 +92,17 @@ class SharedRegion
 {
 private:
 	const std::string     _name;
+	size_t                _size;
+	const size_t          _reserve;
+	size_t                _mapped;
 	shared_region_layout* _region;
 	bool                  _isCreated;
+	int                   _fileDescriptor;   // Kept open by growable regions only, else -1
 
 public:
-	SharedRegion(const char *name) : _name(name), _isCreated(false), _region(nullptr) {}
+	SharedRegion(const char *name, size_t size = sizeof(shared_region_layout), size_t reserve = 0) 
+		: _name(name), _size(size < sizeof(shared_region_layout) ? sizeof(shared_region_layout) : size),
+		  _reserve(reserve), _mapped(0), _region(nullptr), _isCreated(false), _fileDescriptor(-1) {}
 
 	virtual ~SharedRegion() {
 		this->Unmap();
@@ -50,6 +110,8 @@ public:
 
 	const std::string& Name() const { return _name; }
 	const bool IsCreated() const { return _isCreated; }
+	size_t Size() const { return _size; }
+	size_t Reserved() const { return _mapped; }
 
 	bool Create()
 	{
@@ -59,19 +121,28 @@ public:
 		auto fileDescriptor = shm_open(this->_name.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
 		if (fileDescriptor != -1)
 		{
-			(void)! ftruncate(fileDescriptor, sizeof(shared_region_layout));
+			// Only grow the file, another process may have created it larger
+			struct stat fileStat;
+			if (fstat(fileDescriptor, &fileStat) != 0 || (size_t)fileStat.st_size < _size)
+				(void)! ftruncate(fileDescriptor, _size);
+			else
+				_size = (size_t)fileStat.st_size;
 
+			_mapped = _reserve > _size ? _reserve : _size;
 			_region = (shared_region_layout*) mmap(
 				NULL, 
-				sizeof(shared_region_layout), 
+				_mapped, 
 				PROT_READ | PROT_WRITE, 
 				MAP_SHARED, 
 				fileDescriptor, 0);
 
 			if (_region != MAP_FAILED) {
 				_isCreated = true;
-				// Safe to close the file descriptor
-				close(fileDescriptor);
+				// Safe to close the file descriptor, Grow() needs it for growable regions
+				if (_reserve > 0)
+					_fileDescriptor = fileDescriptor;
+				else
+					close(fileDescriptor);
 			}
 			else
 				_region = nullptr; // MAP_FAILED is not nullptr or 0x0, so setting it explicitly
@@ -85,14 +156,47 @@ public:
 		return _isCreated ? _region : nullptr;
 	}
 
+	// Access the region through a layout that begins with shared_region_layout
+	template <typename T>
+	T* GetAs() const
+	{
+		return reinterpret_cast<T*>(this->Get());
+	}
+
+	// Extends the shared file, up to the reserved size. Never shrinks it
+	bool Grow(size_t size)
+	{
+		if (!_isCreated || size > _mapped || _fileDescriptor == -1)
+			return false;
+
+		// The file mapped by Create(), the name may belong to another file by now
+		bool grown = true;
+		struct stat fileStat;
+		if (fstat(_fileDescriptor, &fileStat) != 0)
+			grown = false;
+		else if ((size_t)fileStat.st_size < size)
+			grown = ftruncate(_fileDescriptor, size) == 0;
+		else
+			size = (size_t)fileStat.st_size;
+
+		if (grown)
+			_size = size < _mapped ? size : _mapped;
+		return grown;
+	}
+
 	void Unmap()
 	{
 		// Free up allocated mmap-ed memory
 		if (_region)
 		{
-			munmap(_region, sizeof(shared_region_layout));
+			munmap(_region, _mapped);
 			_region = nullptr;
 		}
+		if (_fileDescriptor != -1)
+		{
+			close(_fileDescriptor);
+			_fileDescriptor = -1;
+		}
 	}
 
 	void Destroy()
@@ -1,6 +1,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <iostream>
+#include <chrono>
 #include <memory>
 #include <vector>
 #include "SharedRegion.hpp"
@@ -15,14 +16,12 @@ private:
 public:
 	SharegRegionTest(const char* name) : _name(name), Region(nullptr) { }
 
-	void Wait() const { SleepFor(WAIT_TIME_1); }
-
 	bool CreateSharedMemory() {
 		Region.reset(new SharedRegion(this->_name.c_str()));
 		return Region->Create();
 	}
 
-    bool DestroySharedMemory() {
+    void DestroySharedMemory() {
         Region->Destroy();
     }
 
@@ -144,8 +143,10 @@ void Test_TwoProcesses_SetValues_Shared()
 {
     logtest(__func__);
 
+    TestBarrier barrier;
     pid_t childPid = fork();
     assert(childPid >= 0, "Process fork failed");
+    barrier.Forked(childPid);
 
     if (childPid == 0) 
     {
@@ -156,12 +157,11 @@ void Test_TwoProcesses_SetValues_Shared()
        test.CreateSharedMemory();
        test.SetCounter(TEST_COUNT_1);
        test.SetTimestamp(TEST_TIMESTAMP);
-       test.Wait();
+       barrier.Arrive(); // Values set
+       barrier.Arrive(); // Parent read them
 
        test.DestroySharedMemory();
-       
-       // Don't proceed till killed by parent
-       while(1) SleepFor(CHILD_SLEEP_TIME);
+       ExitChild();
     }
     else
     {
@@ -170,13 +170,14 @@ void Test_TwoProcesses_SetValues_Shared()
          */
         SharegRegionTest test(SHARE_NAME_1);
         test.CreateSharedMemory();
-        test.Wait();
+        barrier.Arrive();
 
         const auto counter = test.Counter();
         const auto timestamp = test.Timestamp();
+        barrier.Arrive();
 
-        // Kill the child process here
-        kill(childPid, SIGTERM);
+        // Stop the child process here
+        StopChild(childPid);
 
         compare<unsigned int>(counter, TEST_COUNT_1, "Shared values incorrect");
         compare<long>(timestamp, TEST_TIMESTAMP, "Shared values incorrect");
@@ -189,8 +190,10 @@ void Test_TwoProcesses_RunSynchronous_GetDefaultValues()
 {
     logtest(__func__);
 
+    TestBarrier barrier;
     pid_t childPid = fork();
     assert(childPid >= 0, "Process fork failed!");
+    barrier.Forked(childPid);
 
     if (childPid == 0)
     {
@@ -202,18 +205,17 @@ void Test_TwoProcesses_RunSynchronous_GetDefaultValues()
         test.SetCounter(TEST_COUNT_1);
         test.SetTimestamp(TEST_TIMESTAMP);
         test.DestroySharedMemory();
-
-        // Don't proceed till killed by parent
-        while (1) SleepFor(CHILD_SLEEP_TIME);
+        barrier.Arrive();
+        ExitChild();
     }
     else
     {
         /*
          * Parent Process -- assert only after child process stopped!
          */
-        // Wait for child to do it's thing then kill it
-        SleepFor(WAIT_TIME_1 * 1.25);
-        kill(childPid, SIGTERM);
+        // Wait for child to do it's thing then stop it
+        barrier.Arrive();
+        StopChild(childPid);
         
         SharegRegionTest test(SHARE_NAME_1);
         test.CreateSharedMemory();
@@ -229,8 +231,10 @@ void Test_TwoProcesses_WhenOneUnlinks_OtherUnaffected()
 {
     logtest(__func__);
 
+    TestBarrier barrier;
     pid_t childPid = fork();
     assert(childPid >= 0, "Process fork failed!");
+    barrier.Forked(childPid);
 
     if (childPid == 0)
     {
@@ -239,11 +243,10 @@ void Test_TwoProcesses_WhenOneUnlinks_OtherUnaffected()
          */
         SharegRegionTest test(SHARE_NAME_1);
         test.CreateSharedMemory();
-        test.Wait();
+        barrier.Arrive(); // Both mapped
         test.DestroySharedMemory();
-
-        // Don't proceed till killed by parent
-        while (1) SleepFor(CHILD_SLEEP_TIME);
+        barrier.Arrive(); // Unlinked
+        ExitChild();
     }
     else
     {
@@ -254,32 +257,79 @@ void Test_TwoProcesses_WhenOneUnlinks_OtherUnaffected()
         test.CreateSharedMemory();
         test.SetCounter(TEST_COUNT_1);
         test.SetTimestamp(TEST_TIMESTAMP);
-        test.Wait();
-        test.Wait();
+        barrier.Arrive();
+        barrier.Arrive();
 
         const auto counter = test.Counter();
         const auto timestamp = test.Timestamp();
 
-        kill(childPid, SIGTERM);
+        StopChild(childPid);
 
         compare<unsigned int>(counter, TEST_COUNT_1, "Synchronous process values incorrect");
         compare<long>(timestamp, TEST_TIMESTAMP, "Synchronous process values incorrect");
     }
 }
 
+//====================================================================================================
+
+void Test_TwoProcesses_GuardHolderDied_WaitIsBounded()
+{
+    logtest(__func__);
+
+    TestBarrier barrier;
+    pid_t childPid = fork();
+    assert(childPid >= 0, "Process fork failed");
+    barrier.Forked(childPid);
+
+    if (childPid == 0)
+    {
+        /*
+        * Child Process -- don't do assertions here!
+        */
+        SharedRegion region(SHARE_NAME_1);
+        region.Create();
+        region.Get()->mutex.try_lock();
+        barrier.Arrive();
+        ExitChild(); // Exits holding the mutex
+    }
+    else
+    {
+        /*
+         * Parent Process -- assert only after child process stopped!
+         */
+        barrier.Arrive(); // Child holds the mutex
+        StopChild(childPid);
+
+        SharedRegion region(SHARE_NAME_1);
+        region.Create();
+        const auto start = std::chrono::steady_clock::now();
+        bool locked = true;
+        {
+            SharedRegionGuard guard(region.Get()->mutex, WAIT_TIME_1);
+            locked = guard.IsLocked();
+        }
+        const auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        region.Destroy();
+
+        assert(!locked, "Mutex of a dead holder should not be locked");
+        assert(waited >= WAIT_TIME_1 && waited < WAIT_TIME_2, "Guard should give up after its timeout");
+    }
+}
+
 //====================================================================================================
 //====================================================================================================
 
-static std::vector<TEST_TYPE> GetSharedRegionTests()
+static std::vector<TestCase> GetSharedRegionTests()
 {
-    return std::vector<TEST_TYPE> {
-        &Test_SingleProcess_DefaultValues_Correct,
-        &Test_SingleProcess_SetCounts_Correct,
-        &Test_SingleProcess_SetCounts_ResetsOnDestroy,
-        &Test_SingleProcess_Unmap_FreesMemory,
-        &Test_SingleProcess_NoDestroy_RetainsOldValues,
-        &Test_TwoProcesses_SetValues_Shared,
-        &Test_TwoProcesses_RunSynchronous_GetDefaultValues,
-        &Test_TwoProcesses_WhenOneUnlinks_OtherUnaffected,
+    return std::vector<TestCase> {
+        TEST_CASE(Test_SingleProcess_DefaultValues_Correct),
+        TEST_CASE(Test_SingleProcess_SetCounts_Correct),
+        TEST_CASE(Test_SingleProcess_SetCounts_ResetsOnDestroy),
+        TEST_CASE(Test_SingleProcess_Unmap_FreesMemory),
+        TEST_CASE(Test_SingleProcess_NoDestroy_RetainsOldValues),
+        TEST_CASE(Test_TwoProcesses_SetValues_Shared),
+        TEST_CASE(Test_TwoProcesses_RunSynchronous_GetDefaultValues),
+        TEST_CASE(Test_TwoProcesses_WhenOneUnlinks_OtherUnaffected),
+        TEST_CASE(Test_TwoProcesses_GuardHolderDied_WaitIsBounded),
     };
 }
\ No newline at end of file
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include "SharedRegion.hpp"
+#include "SharedLifecycle.hpp"
+#include "SharedFutex.hpp"
+#include "ForkGeneration.hpp"
+
+constexpr unsigned int SHARED_SNAPSHOT_BUFFERS     = 3;    /* Default: published, being written, kept for slow readers */
+constexpr unsigned int SHARED_SNAPSHOT_MAX_BUFFERS = 16;
+constexpr unsigned int SHARED_SNAPSHOT_READERS     = 128;  /* Reading instances at once */
+constexpr long         SHARED_SNAPSHOT_WRITE_POLL  = 1;    /* Milliseconds between looks for a free buffer */
+constexpr size_t       SHARED_SNAPSHOT_LINE        = 64;
+
+/*
+* One of the buffers snapshots are written to
+*/
+struct shared_snapshot_buffer {
+	std::atomic<uint64_t> epoch;   // Epoch it was published in, 0 if never
+	uint64_t              size;    // Bytes published
+};
+
+/*
+* Reader slot, alone on its cache line since every Pin() writes it
+*/
+struct alignas(SHARED_SNAPSHOT_LINE) shared_snapshot_reader {
+	std::atomic<pid_t>    pid;     // 0 when the slot is free
+	std::atomic<uint64_t> epoch;   // Pinned epoch, 0 when not reading
+};
+
+/*
+* This struct is what is mapped to memory, the buffers follow it.
+*/
+struct shared_snapshot_layout {
+	shared_region_layout   header;
+	uint32_t               bufferCount;
+	uint64_t               bufferSize;
+	std::atomic<uint64_t>  current;     // Published epoch << 8 | buffer index, 0 before the first Publish()
+	std::atomic<pid_t>     writer;      // Process between BeginWrite() and Publish()
+	uint64_t               lastEpoch;   // Only changed by the writer
+	shared_snapshot_buffer buffers[SHARED_SNAPSHOT_MAX_BUFFERS];
+	shared_snapshot_reader readers[SHARED_SNAPSHOT_READERS];
+};
+
+/*
+* - Publishes a large block of data to many reader processes without locks
+*   and without copies. The region holds several buffers, 3 by default
+* - The writer fills a buffer no reader uses and publishes it by storing its
+*   index and a new epoch into one atomic word. One writer at a time
+* - Readers Pin() the published buffer and read it in place. Pinning writes
+*   the epoch into the instance's reader slot and never blocks or waits for
+*   the writer. A buffer is only written again once no slot pins its epoch
+* - When all buffers but the published one are pinned, BeginWrite() waits
+*   for a reader to move on, up to its timeout
+* - Each process reads through its own instance, one pin at a time. Slots of
+*   dead readers and the writer role of a dead writer are reclaimed
+* - Reference counted like LinuxSharedMutex, but never recreated for an old
+*   timestamp: long-lived readers would keep pinning the old region while
+*   the writer publishes into a new one
+*/
+class SharedSnapshot
+{
+private:
+	const std::string             _name;
+	std::unique_ptr<SharedRegion> _share;
+	int                           _reader;
+	unsigned int                  _readerGeneration;
+	int                           _writing;
+
+public:
+	SharedSnapshot(const char *name, size_t bufferSize, unsigned int buffers = SHARED_SNAPSHOT_BUFFERS)
+		: _name(name), _reader(-1), _readerGeneration(0), _writing(-1)
+	{
+		buffers = std::min(std::max(buffers, 2u), SHARED_SNAPSHOT_MAX_BUFFERS);
+		_share.reset(new SharedRegion(name, DataOffset() + buffers * RoundToLine(bufferSize)));
+		AttachSharedRegion(*_share, [this, bufferSize, buffers] {
+			auto layout = Layout();
+			layout->bufferCount = buffers;
+			layout->bufferSize = bufferSize;
+		}, 0);
+		ForkGeneration(); // Install the fork handler
+	}
+
+	virtual ~SharedSnapshot()
+	{
+		this->Release();
+	}
+
+	const std::string& Name() const { return _name; }
+	size_t BufferSize() const { return Layout() ? Layout()->bufferSize : 0; }
+
+	// Epoch of the published snapshot, 0 before the first one
+	uint64_t Epoch() const
+	{
+		return Layout() ? Layout()->current.load(std::memory_order_acquire) >> 8 : 0;
+	}
+
+	/*
+	* Writer
+	*/
+
+	// Returns the buffer to fill, or nullptr when another writer or the readers kept all buffers busy
+	void* BeginWrite(int timeout)
+	{
+		auto layout = Layout();
+		if (layout == nullptr)
+			return nullptr;
+		if (_writing >= 0)
+			return Buffer(_writing);
+
+		const pid_t pid = getpid();
+		const long deadline = FutexMillisecondsNow() + timeout;
+		for (;;)
+		{
+			pid_t writer = 0;
+			if (layout->writer.compare_exchange_strong(writer, pid, std::memory_order_acquire))
+				break;
+			if (writer != pid && !IsProcessAlive(writer) && layout->writer.compare_exchange_strong(writer, pid, std::memory_order_acquire))
+				break;
+			if (FutexMillisecondsNow() >= deadline)
+				return nullptr;
+			std::this_thread::sleep_for(std::chrono::milliseconds(SHARED_SNAPSHOT_WRITE_POLL));
+		}
+
+		for (;;)
+		{
+			const int index = FreeBuffer();
+			if (index >= 0)
+			{
+				_writing = index;
+				return Buffer(index);
+			}
+			if (FutexMillisecondsNow() >= deadline)
+			{
+				layout->writer.store(0, std::memory_order_release);
+				return nullptr;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(SHARED_SNAPSHOT_WRITE_POLL));
+		}
+	}
+
+	// Makes the written buffer the current snapshot
+	bool Publish(size_t size)
+	{
+		auto layout = Layout();
+		if (layout == nullptr || _writing < 0 || size > layout->bufferSize)
+			return false;
+
+		auto &buffer = layout->buffers[_writing];
+		const uint64_t epoch = ++layout->lastEpoch;
+		buffer.size = size;
+		buffer.epoch.store(epoch, std::memory_order_relaxed);
+		layout->current.store(epoch << 8 | (uint64_t) _writing, std::memory_order_seq_cst);
+
+		_writing = -1;
+		layout->writer.store(0, std::memory_order_release);
+		return true;
+	}
+
+	void AbortWrite()
+	{
+		auto layout = Layout();
+		if (layout == nullptr || _writing < 0)
+			return;
+
+		_writing = -1;
+		layout->writer.store(0, std::memory_order_release);
+	}
+
+	/*
+	* Reader
+	*/
+
+	// Returns the current snapshot, valid until Unpin() or the next Pin()
+	const void* Pin(size_t *size = nullptr)
+	{
+		auto reader = ReaderSlot();
+		if (reader == nullptr)
+			return nullptr;
+
+		auto layout = Layout();
+		uint64_t current;
+		for (;;)
+		{
+			current = layout->current.load(std::memory_order_seq_cst);
+			if (current == 0)
+			{
+				reader->epoch.store(0, std::memory_order_release);
+				return nullptr;
+			}
+
+			// The writer reuses no buffer pinned before it published, so check nothing was published meanwhile
+			reader->epoch.store(current >> 8, std::memory_order_seq_cst);
+			if (layout->current.load(std::memory_order_seq_cst) == current)
+				break;
+		}
+
+		const unsigned int index = (unsigned int) (current & 0xff);
+		if (size != nullptr)
+			*size = layout->buffers[index].size;
+		return Buffer(index);
+	}
+
+	void Unpin()
+	{
+		if (_reader >= 0 && _readerGeneration == ForkGenerationCounter() && Layout() != nullptr)
+			Layout()->readers[_reader].epoch.store(0, std::memory_order_release);
+	}
+
+	void Release()
+	{
+		auto layout = Layout();
+		if (layout == nullptr)
+			return;
+
+		AbortWrite();
+		if (_reader >= 0 && _readerGeneration == ForkGenerationCounter())
+		{
+			layout->readers[_reader].epoch.store(0, std::memory_order_release);
+			layout->readers[_reader].pid.store(0, std::memory_order_release);
+		}
+		_reader = -1;
+		DetachSharedRegion(*_share);
+	}
+
+private:
+	shared_snapshot_layout* Layout() const
+	{
+		return _share->GetAs<shared_snapshot_layout>();
+	}
+
+	char* Buffer(unsigned int index) const
+	{
+		return reinterpret_cast<char*>(Layout()) + DataOffset() + index * RoundToLine(Layout()->bufferSize);
+	}
+
+	shared_snapshot_reader* ReaderSlot()
+	{
+		auto layout = Layout();
+		if (layout == nullptr)
+			return nullptr;
+
+		// A forked child does not share the slot of its parent
+		if (_reader >= 0 && _readerGeneration == ForkGenerationCounter())
+			return &layout->readers[_reader];
+
+		// Take a free slot, or else one of a dead reader
+		_reader = -1;
+		const pid_t pid = getpid();
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (unsigned int slot = 0; slot < SHARED_SNAPSHOT_READERS; ++slot)
+			{
+				auto &reader = layout->readers[slot];
+				pid_t owner = reader.pid.load(std::memory_order_relaxed);
+				if ((owner == 0 || (pass == 1 && owner != pid && !IsProcessAlive(owner))) &&
+					reader.pid.compare_exchange_strong(owner, pid, std::memory_order_acq_rel))
+				{
+					reader.epoch.store(0, std::memory_order_relaxed);
+					_reader = (int) slot;
+					_readerGeneration = ForkGenerationCounter();
+					return &reader;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	// Needs the writer role. Prefers the oldest buffer no reader pins
+	int FreeBuffer()
+	{
+		auto layout = Layout();
+		const uint64_t current = layout->current.load(std::memory_order_seq_cst);
+		const int currentIndex = current == 0 ? -1 : (int) (current & 0xff);
+
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			int free = -1;
+			for (unsigned int index = 0; index < layout->bufferCount; ++index)
+			{
+				const uint64_t epoch = layout->buffers[index].epoch.load(std::memory_order_relaxed);
+				if ((int) index == currentIndex || (epoch != 0 && IsPinned(epoch, pass == 1)))
+					continue;
+				if (free < 0 || epoch < layout->buffers[free].epoch.load(std::memory_order_relaxed))
+					free = (int) index;
+			}
+			if (free >= 0)
+				return free;
+		}
+		return -1;
+	}
+
+	// Optionally frees the slots of readers that died
+	bool IsPinned(uint64_t epoch, bool reclaimDead)
+	{
+		auto layout = Layout();
+		bool pinned = false;
+		for (auto &reader : layout->readers)
+		{
+			const pid_t pid = reader.pid.load(std::memory_order_seq_cst);
+			if (pid == 0 || reader.epoch.load(std::memory_order_seq_cst) != epoch)
+				continue;
+
+			// Only the pid is swapped, the epoch belongs to whoever claims the slot next.
+			// A reader that claimed it meanwhile may pin this epoch, so it counts as pinned
+			pid_t owner = pid;
+			if (reclaimDead && pid != getpid() && !IsProcessAlive(pid) &&
+				reader.pid.compare_exchange_strong(owner, 0, std::memory_order_release))
+				continue;
+			pinned = true;
+		}
+		return pinned;
+	}
+
+	static constexpr size_t RoundToLine(size_t size)
+	{
+		return (size + SHARED_SNAPSHOT_LINE - 1) & ~(SHARED_SNAPSHOT_LINE - 1);
+	}
+
+	static constexpr size_t DataOffset()
+	{
+		return RoundToLine(sizeof(shared_snapshot_layout));
+	}
+};
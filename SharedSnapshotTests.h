@@ -0,0 +1,236 @@
+#include <vector>
+#include <string>
+#include <cstring>
+#include <atomic>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include "SharedSnapshot.hpp"
+#include "TestHelpers.h"
+
+constexpr TestName SNAPSHOT_NAME_1 = "SNAPSHOT_1";
+
+constexpr size_t SNAPSHOT_SIZE_1 = 64 * 1024;
+
+// Fills a buffer with its epoch, so torn snapshots can be told apart
+static bool PublishSnapshot(SharedSnapshot &snapshot, int timeout)
+{
+	auto buffer = static_cast<uint64_t*>(snapshot.BeginWrite(timeout));
+	if (buffer == nullptr)
+		return false;
+	const uint64_t epoch = snapshot.Epoch() + 1;
+	for (size_t i = 0; i < SNAPSHOT_SIZE_1 / sizeof(uint64_t); ++i)
+		buffer[i] = epoch;
+	return snapshot.Publish(SNAPSHOT_SIZE_1);
+}
+
+static bool IsSnapshotConsistent(const void *data)
+{
+	auto values = static_cast<const uint64_t*>(data);
+	for (size_t i = 1; i < SNAPSHOT_SIZE_1 / sizeof(uint64_t); ++i)
+	{
+		if (values[i] != values[0])
+			return false;
+	}
+	return true;
+}
+
+//====================================================================================================
+//====================================================================================================
+
+void Test_SharedSnapshot_Published_ReaderSeesIt()
+{
+	logtest(__func__);
+
+	SharedSnapshot writer(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+	SharedSnapshot reader(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+
+	auto beforePublish = reader.Pin();
+	auto buffer = static_cast<char*>(writer.BeginWrite(0));
+	strcpy(buffer, "routes v1");
+	const bool published = writer.Publish(strlen(buffer) + 1);
+
+	size_t size = 0;
+	auto data = static_cast<const char*>(reader.Pin(&size));
+	reader.Unpin();
+
+	assert(beforePublish == nullptr, "Nothing should be pinned before the first publish");
+	assert(published, "Publish failed");
+	compare<uint64_t>(reader.Epoch(), 1, "First publish should be epoch 1");
+	compare<size_t>(size, 10, "Published size incorrect");
+	compare<std::string>(std::string(data), "routes v1", "Reader should see the published data");
+}
+
+void Test_SharedSnapshot_PinnedBuffer_NotOverwritten()
+{
+	logtest(__func__);
+
+	SharedSnapshot writer(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+	SharedSnapshot reader(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+
+	PublishSnapshot(writer, 0);
+	auto pinned = static_cast<const uint64_t*>(reader.Pin());
+	bool published = true;
+	for (int i = 0; i < 10; ++i)
+		published = PublishSnapshot(writer, 0) && published;
+	const uint64_t pinnedValue = pinned[0];
+	const bool pinnedConsistent = IsSnapshotConsistent(pinned);
+	auto latest = static_cast<const uint64_t*>(reader.Pin());
+
+	assert(published, "Writer should not wait with a free buffer left");
+	compare<uint64_t>(pinnedValue, 1, "Pinned snapshot was overwritten");
+	assert(pinnedConsistent, "Pinned snapshot was partly overwritten");
+	compare<uint64_t>(latest[0], 11, "Pinning again should give the latest snapshot");
+}
+
+void Test_SharedSnapshot_AllBuffersPinned_WriterWaits()
+{
+	logtest(__func__);
+
+	SharedSnapshot writer(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1, 2);
+	SharedSnapshot reader(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+
+	PublishSnapshot(writer, 0);
+	reader.Pin();
+	PublishSnapshot(writer, 0);
+	// The published buffer and the pinned one are the only two
+	const bool publishedWhilePinned = PublishSnapshot(writer, WAIT_TIME_1);
+	reader.Unpin();
+	const bool publishedAfterUnpin = PublishSnapshot(writer, 0);
+
+	assert(!publishedWhilePinned, "Writer should not overwrite a pinned buffer");
+	assert(publishedAfterUnpin, "Writer should reuse the buffer after unpin");
+	compare<uint64_t>(writer.Epoch(), 3, "Epoch incorrect");
+}
+
+void Test_SharedSnapshot_ReaderInOtherProcess_NeverSeesTornSnapshot()
+{
+	logtest(__func__);
+
+	// Results of the child, outside of the library
+	auto results = static_cast<std::atomic<int>*>(mmap(NULL, 2 * sizeof(std::atomic<int>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+	assert(results != MAP_FAILED, "Mapping the results failed");
+	results[0].store(0);
+	results[1].store(0);
+
+	SharedSnapshot writer(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+	PublishSnapshot(writer, 0);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		SharedSnapshot reader(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+		barrier.Arrive();
+		for (int i = 0; i < 2000; ++i)
+		{
+			auto data = reader.Pin();
+			if (data == nullptr || !IsSnapshotConsistent(data))
+				results[1].fetch_add(1);
+			results[0].fetch_add(1);
+			reader.Unpin();
+		}
+		barrier.Arrive();
+		ExitChild();
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		barrier.Arrive(); // Child is reading
+		bool published = true;
+		while (results[0].load() < 2000)
+			published = PublishSnapshot(writer, WAIT_TIME_2) && published;
+		barrier.Arrive();
+		StopChild(childPid);
+
+		const int reads = results[0].load();
+		const int torn = results[1].load();
+		munmap(results, 2 * sizeof(std::atomic<int>));
+
+		assert(published, "Writer should never wait for a single reader");
+		compare<int>(reads, 2000, "Child did not finish reading");
+		compare<int>(torn, 0, "Reader saw a torn snapshot");
+	}
+}
+
+void Test_SharedSnapshot_ReaderDiedPinning_BufferReclaimed()
+{
+	logtest(__func__);
+
+	SharedSnapshot writer(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1, 2);
+	PublishSnapshot(writer, 0);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		SharedSnapshot reader(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+		reader.Pin();
+		barrier.Arrive();
+		ExitChild(); // Exits with the snapshot pinned
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		barrier.Arrive();
+		PublishSnapshot(writer, 0);
+		const bool publishedWhileAlive = PublishSnapshot(writer, WAIT_TIME_1);
+		StopChild(childPid);
+		const bool publishedAfterDeath = PublishSnapshot(writer, WAIT_TIME_2);
+
+		assert(!publishedWhileAlive, "Buffer pinned by a live reader should not be reused");
+		assert(publishedAfterDeath, "Buffer pinned by a dead reader should be reclaimed");
+	}
+}
+
+void Test_SharedSnapshot_OldTimestamp_ReadersKeepSeeingPublishes()
+{
+	logtest(__func__);
+
+	SharedSnapshot writer(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+	PublishSnapshot(writer, 0);
+
+	// Age the snapshot far beyond SHARED_REGION_STALE_TIME
+	SharedRegion region(SNAPSHOT_NAME_1);
+	region.Create();
+	region.Get()->timestamp = 1;
+
+	SharedSnapshot reader(SNAPSHOT_NAME_1, SNAPSHOT_SIZE_1);
+	const uint64_t epochBefore = reader.Epoch();
+	PublishSnapshot(writer, 0);
+	const uint64_t epochAfter = reader.Epoch();
+
+	compare<uint64_t>(epochBefore, 1, "Old snapshot was recreated");
+	compare<uint64_t>(epochAfter, 2, "Reader does not see what the writer publishes");
+}
+
+//====================================================================================================
+//====================================================================================================
+
+static std::vector<TestCase> GetSharedSnapshotTests()
+{
+	return std::vector<TestCase> {
+		TEST_CASE(Test_SharedSnapshot_Published_ReaderSeesIt),
+		TEST_CASE(Test_SharedSnapshot_PinnedBuffer_NotOverwritten),
+		TEST_CASE(Test_SharedSnapshot_AllBuffersPinned_WriterWaits),
+		TEST_CASE(Test_SharedSnapshot_ReaderInOtherProcess_NeverSeesTornSnapshot),
+		TEST_CASE(Test_SharedSnapshot_ReaderDiedPinning_BufferReclaimed),
+		TEST_CASE(Test_SharedSnapshot_OldTimestamp_ReadersKeepSeeingPublishes),
+	};
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include "SharedRegion.hpp"
+#include "SharedLifecycle.hpp"
+#include "SharedFutex.hpp"
+
+constexpr uint32_t SHARED_EXCLUSIVE_HELD  = 0x80000000;  /* The upgradable holder is or is becoming exclusive */
+constexpr uint32_t SHARED_READERS_MASK    = 0x7fffffff;  /* Number of shared holders */
+
+enum class SharedLockMode { None, Shared, Upgradable, Exclusive };
+
+/*
+* This struct is what is mapped to memory.
+*/
+struct shared_upgradable_layout {
+	shared_region_layout  header;
+	std::atomic<uint32_t> state;     // Readers | SHARED_EXCLUSIVE_HELD. The futex word readers and upgrades wait on
+	std::atomic<uint32_t> waiters;   // Threads sleeping on the state
+	std::atomic<uint32_t> upgrader;  // FutexLock() word of the upgradable lock, holds the owner pid
+};
+
+/*
+* - Named reader/writer lock with three modes:
+*   - Shared: any number of holders, together with one upgradable holder
+*   - Upgradable: one holder at a time, readers are still let in. TryUpgrade()
+*     turns it into exclusive without releasing it, so what was read under
+*     the upgradable lock is still valid after the upgrade
+*   - Exclusive: no other holder. TryLock() takes the upgradable lock and
+*     upgrades it
+* - While an upgrade waits for the readers to drain, new readers wait too, so
+*   a steady stream of readers cannot starve it. A timed out upgrade keeps
+*   the upgradable lock
+* - Waiting threads sleep on a futex and are woken by the process releasing
+*   the lock. The upgradable lock is a FutexLock() holding the owner's pid,
+*   only the holder sets or clears SHARED_EXCLUSIVE_HELD. The lock of a
+*   process that died upgradable or exclusive is taken over by the next
+*   waiter within SHARED_LOCK_POLL_TIME, swapping out exactly the dead pid.
+*   Shared locks of a dead process are not recovered, same as LinuxSharedMutex
+* - One instance holds one mode at a time, Unlock() releases whichever it is
+* - Follows the refcount/timestamp lifecycle of LinuxSharedMutex
+*/
+class LinuxSharedUpgradableMutex
+{
+private:
+	enum class Attempt { Acquired, Blocked, Retry };
+
+	const std::string             _name;
+	std::unique_ptr<SharedRegion> _share;
+	SharedLockMode                _mode;
+
+public:
+	LinuxSharedUpgradableMutex(const char *name)
+		: _name(name), _share(new SharedRegion(name, sizeof(shared_upgradable_layout))), _mode(SharedLockMode::None)
+	{
+		AttachSharedRegion(*_share, nullptr);
+	}
+
+	virtual ~LinuxSharedUpgradableMutex()
+	{
+		this->Release();
+	}
+
+	virtual std::string_view Name() const { return _name; }
+	virtual SharedLockMode Mode() const { return _mode; }
+	virtual bool IsLocked() const { return _mode != SharedLockMode::None; }
+
+	virtual bool TryLockShared(int timeout)
+	{
+		if (_mode != SharedLockMode::None)
+			return false;
+
+		auto layout = Layout();
+		const bool locked = Wait(timeout, [layout](uint32_t state) {
+			if (state & SHARED_EXCLUSIVE_HELD)
+				return Attempt::Blocked;
+			return layout->state.compare_exchange_weak(state, state + 1, std::memory_order_acquire) ? Attempt::Acquired : Attempt::Retry;
+		});
+		if (locked)
+			_mode = SharedLockMode::Shared;
+		return locked;
+	}
+
+	virtual bool TryLockUpgradable(int timeout)
+	{
+		auto layout = Layout();
+		if (layout == nullptr || _mode != SharedLockMode::None)
+			return false;
+		if (!FutexLock(layout->upgrader, timeout))
+			return false;
+
+		// Set when taken over from a process that died exclusive
+		ClearExclusive();
+		_mode = SharedLockMode::Upgradable;
+		return true;
+	}
+
+	// Holding the upgradable lock, waits for the readers to leave
+	virtual bool TryUpgrade(int timeout)
+	{
+		if (_mode != SharedLockMode::Upgradable)
+			return false;
+
+		auto layout = Layout();
+		layout->state.fetch_or(SHARED_EXCLUSIVE_HELD, std::memory_order_acquire);
+		const bool upgraded = Wait(timeout, [](uint32_t state) {
+			return (state & SHARED_READERS_MASK) == 0 ? Attempt::Acquired : Attempt::Blocked;
+		});
+
+		if (upgraded)
+			_mode = SharedLockMode::Exclusive;
+		else
+			ClearExclusive(); // Let the readers waiting behind the upgrade in again
+		return upgraded;
+	}
+
+	virtual bool TryLock(int timeout)
+	{
+		const long deadline = FutexMillisecondsNow() + timeout;
+		if (!TryLockUpgradable(timeout))
+			return false;
+
+		const long remaining = timeout < 0 ? -1 : std::max(0L, deadline - FutexMillisecondsNow());
+		if (!TryUpgrade((int) remaining))
+		{
+			this->Unlock();
+			return false;
+		}
+		return true;
+	}
+
+	// Exclusive to upgradable, readers are let in again
+	virtual void Downgrade()
+	{
+		if (_mode != SharedLockMode::Exclusive)
+			return;
+
+		ClearExclusive();
+		_mode = SharedLockMode::Upgradable;
+	}
+
+	virtual void Unlock()
+	{
+		auto layout = Layout();
+		if (layout == nullptr || _mode == SharedLockMode::None)
+			return;
+
+		if (_mode == SharedLockMode::Shared)
+		{
+			const uint32_t state = layout->state.fetch_sub(1, std::memory_order_release) - 1;
+			// Only a pending upgrade waits for the last reader
+			if ((state & SHARED_READERS_MASK) == 0 && (state & SHARED_EXCLUSIVE_HELD))
+				WakeWaiters();
+		}
+		else
+		{
+			ClearExclusive();
+			FutexUnlock(layout->upgrader);
+		}
+		_mode = SharedLockMode::None;
+	}
+
+	virtual void Release()
+	{
+		if (Layout() == nullptr)
+			return;
+
+		this->Unlock();
+		DetachSharedRegion(*_share);
+	}
+
+private:
+	shared_upgradable_layout* Layout() const
+	{
+		return _share->GetAs<shared_upgradable_layout>();
+	}
+
+	// A timeout below 0 waits forever
+	bool Wait(long timeout, const std::function<Attempt(uint32_t)> &attempt)
+	{
+		auto layout = Layout();
+		if (layout == nullptr)
+			return false;
+
+		const long deadline = FutexMillisecondsNow() + timeout;
+		for (;;)
+		{
+			const uint32_t state = layout->state.load(std::memory_order_acquire);
+			const Attempt result = attempt(state);
+			if (result == Attempt::Acquired)
+				return true;
+			if (result == Attempt::Retry)
+				continue;
+
+			const long remaining = timeout < 0 ? SHARED_LOCK_POLL_TIME : deadline - FutexMillisecondsNow();
+			if (remaining <= 0)
+				return false;
+
+			layout->waiters.fetch_add(1);
+			FutexWait(layout->state, state, std::min(remaining, SHARED_LOCK_POLL_TIME));
+			layout->waiters.fetch_sub(1);
+
+			RecoverFromDeadOwner(state);
+		}
+	}
+
+	// Readers wait on the state, not on the upgradable lock, so they free the lock of a process that died exclusive
+	void RecoverFromDeadOwner(uint32_t state)
+	{
+		auto layout = Layout();
+		if ((state & SHARED_EXCLUSIVE_HELD) == 0)
+			return;
+		uint32_t upgrader = layout->upgrader.load(std::memory_order_relaxed);
+		const pid_t owner = (pid_t) (upgrader & ~SHARED_LOCK_WAITERS);
+		if (owner == 0 || owner == getpid() || IsProcessAlive(owner))
+			return;
+
+		// Only succeeds while the dead process still holds the lock, then unlocks as it would have
+		const uint32_t taken = (uint32_t) getpid() | (upgrader & SHARED_LOCK_WAITERS);
+		if (layout->upgrader.compare_exchange_strong(upgrader, taken, std::memory_order_acquire))
+		{
+			ClearExclusive();
+			FutexUnlock(layout->upgrader);
+		}
+	}
+
+	// Needs the upgradable lock
+	void ClearExclusive()
+	{
+		if (Layout()->state.fetch_and(~SHARED_EXCLUSIVE_HELD, std::memory_order_release) & SHARED_EXCLUSIVE_HELD)
+			WakeWaiters();
+	}
+
+	void WakeWaiters()
+	{
+		auto layout = Layout();
+		if (layout->waiters.load() > 0)
+			FutexWake(layout->state);
+	}
+};
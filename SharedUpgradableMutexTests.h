@@ -0,0 +1,207 @@
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <signal.h>
+#include "SharedUpgradableMutex.hpp"
+#include "TestHelpers.h"
+
+constexpr TestName UPGRADABLE_NAME_1 = "UPGRADABLE_MUTEX_1";
+
+//====================================================================================================
+//====================================================================================================
+
+void Test_SharedUpgradableMutex_SharedHolders_ExcludeOnlyExclusive()
+{
+	logtest(__func__);
+
+	LinuxSharedUpgradableMutex reader1(UPGRADABLE_NAME_1);
+	LinuxSharedUpgradableMutex reader2(UPGRADABLE_NAME_1);
+	LinuxSharedUpgradableMutex upgrader(UPGRADABLE_NAME_1);
+	LinuxSharedUpgradableMutex writer(UPGRADABLE_NAME_1);
+
+	const bool shared1 = reader1.TryLockShared(0);
+	const bool shared2 = reader2.TryLockShared(0);
+	const bool upgradable = upgrader.TryLockUpgradable(0);
+	const bool exclusive = writer.TryLock(WAIT_TIME_1);
+	reader1.Unlock();
+	reader2.Unlock();
+	upgrader.Unlock();
+	const bool exclusiveAfterUnlock = writer.TryLock(0);
+	const bool sharedWhileExclusive = reader1.TryLockShared(WAIT_TIME_1);
+	writer.Unlock();
+
+	assert(shared1 && shared2, "Shared locks should not exclude each other");
+	assert(upgradable, "Upgradable lock should be allowed next to readers");
+	assert(!exclusive, "Exclusive lock should wait for readers and the upgradable holder");
+	assert(exclusiveAfterUnlock, "Exclusive lock should be free after everyone unlocked");
+	assert(!sharedWhileExclusive, "Shared lock should wait for the exclusive holder");
+	assert(writer.Mode() == SharedLockMode::None, "Unlock should leave no mode held");
+}
+
+void Test_SharedUpgradableMutex_SecondUpgradable_Waits()
+{
+	logtest(__func__);
+
+	LinuxSharedUpgradableMutex first(UPGRADABLE_NAME_1);
+	LinuxSharedUpgradableMutex second(UPGRADABLE_NAME_1);
+
+	const bool firstLocked = first.TryLockUpgradable(0);
+	const bool secondLocked = second.TryLockUpgradable(WAIT_TIME_1);
+	first.Unlock();
+	const bool secondAfterUnlock = second.TryLockUpgradable(0);
+
+	assert(firstLocked, "First upgradable lock failed");
+	assert(!secondLocked, "Only one upgradable holder is allowed");
+	assert(secondAfterUnlock, "Upgradable lock should be free after unlock");
+}
+
+void Test_SharedUpgradableMutex_UpgradeWithReaderInOtherProcess_WaitsForItToDrain()
+{
+	logtest(__func__);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		LinuxSharedUpgradableMutex mutex(UPGRADABLE_NAME_1);
+		mutex.TryLockShared(WAIT_TIME_2);
+		barrier.Arrive();
+		barrier.Arrive(); // First upgrade timed out
+		mutex.Unlock();
+		barrier.Arrive();
+		ExitChild();
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		LinuxSharedUpgradableMutex mutex(UPGRADABLE_NAME_1);
+		LinuxSharedUpgradableMutex reader(UPGRADABLE_NAME_1);
+		barrier.Arrive(); // Child holds a shared lock
+		mutex.TryLockUpgradable(0);
+		const bool upgradedWithReader = mutex.TryUpgrade(WAIT_TIME_1);
+		const SharedLockMode modeAfterTimeout = mutex.Mode();
+		const bool readerAfterTimeout = reader.TryLockShared(0);
+		reader.Unlock();
+		barrier.Arrive();
+		const bool upgraded = mutex.TryUpgrade(WAIT_TIME_2);
+		barrier.Arrive();
+		StopChild(childPid);
+
+		assert(!upgradedWithReader, "Upgrade should wait while another process reads");
+		assert(modeAfterTimeout == SharedLockMode::Upgradable, "Timed out upgrade should keep the upgradable lock");
+		assert(readerAfterTimeout, "Readers should be let in again after a timed out upgrade");
+		assert(upgraded, "Upgrade should succeed once the reader unlocked");
+		assert(mutex.Mode() == SharedLockMode::Exclusive, "Mode should be exclusive after upgrading");
+	}
+}
+
+void Test_SharedUpgradableMutex_Downgrade_LetsReadersIn()
+{
+	logtest(__func__);
+
+	LinuxSharedUpgradableMutex writer(UPGRADABLE_NAME_1);
+	LinuxSharedUpgradableMutex reader(UPGRADABLE_NAME_1);
+
+	writer.TryLock(0);
+	const bool readWhileExclusive = reader.TryLockShared(0);
+	writer.Downgrade();
+	const bool readAfterDowngrade = reader.TryLockShared(0);
+
+	assert(!readWhileExclusive, "Reader should wait for the exclusive holder");
+	assert(readAfterDowngrade, "Reader should get in after the downgrade");
+	assert(writer.Mode() == SharedLockMode::Upgradable, "Downgrade should keep the upgradable lock");
+}
+
+void Test_SharedUpgradableMutex_UpgradableOwnerDied_WaiterTakesOver()
+{
+	logtest(__func__);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		LinuxSharedUpgradableMutex mutex(UPGRADABLE_NAME_1);
+		mutex.TryLock(WAIT_TIME_2);
+		barrier.Arrive();
+		ExitChild(); // Exits holding the exclusive lock
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		LinuxSharedUpgradableMutex mutex(UPGRADABLE_NAME_1);
+		barrier.Arrive();
+		StopChild(childPid);
+		const bool locked = mutex.TryLock(WAIT_TIME_2);
+
+		assert(locked, "Exclusive lock of a dead process should be taken over");
+	}
+}
+
+void Test_SharedUpgradableMutex_ExclusiveOwnerDied_ReaderGetsIn()
+{
+	logtest(__func__);
+
+	TestBarrier barrier;
+	pid_t childPid = fork();
+	assert(childPid >= 0, "Process fork failed");
+	barrier.Forked(childPid);
+
+	if (childPid == 0)
+	{
+		/*
+		* Child Process -- don't do assertions here!
+		*/
+		LinuxSharedUpgradableMutex mutex(UPGRADABLE_NAME_1);
+		mutex.TryLock(WAIT_TIME_2);
+		barrier.Arrive();
+		ExitChild(); // Exits holding the exclusive lock
+	}
+	else
+	{
+		/*
+		* Parent Process -- assert only after child process stopped!
+		*/
+		LinuxSharedUpgradableMutex reader(UPGRADABLE_NAME_1);
+		LinuxSharedUpgradableMutex upgrader(UPGRADABLE_NAME_1);
+		barrier.Arrive();
+		const bool readWhileAlive = reader.TryLockShared(WAIT_TIME_1);
+		StopChild(childPid);
+		const bool read = reader.TryLockShared(WAIT_TIME_2);
+		const bool upgradable = upgrader.TryLockUpgradable(0);
+
+		assert(!readWhileAlive, "Reader should wait for a live exclusive holder");
+		assert(read, "Reader should get in once the exclusive holder died");
+		assert(upgradable, "Lock of the dead process should have been freed");
+	}
+}
+
+//====================================================================================================
+//====================================================================================================
+
+static std::vector<TestCase> GetSharedUpgradableMutexTests()
+{
+	return std::vector<TestCase> {
+		TEST_CASE(Test_SharedUpgradableMutex_SharedHolders_ExcludeOnlyExclusive),
+		TEST_CASE(Test_SharedUpgradableMutex_SecondUpgradable_Waits),
+		TEST_CASE(Test_SharedUpgradableMutex_UpgradeWithReaderInOtherProcess_WaitsForItToDrain),
+		TEST_CASE(Test_SharedUpgradableMutex_Downgrade_LetsReadersIn),
+		TEST_CASE(Test_SharedUpgradableMutex_UpgradableOwnerDied_WaiterTakesOver),
+		TEST_CASE(Test_SharedUpgradableMutex_ExclusiveOwnerDied_ReaderGetsIn),
+	};
+}
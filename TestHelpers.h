@@ -4,23 +4,70 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
 
 constexpr const char *divider1 = "======================================";
 constexpr const char *divider2 = "--------------------------------------";
 constexpr const char *divider3 = "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
 std::string LastError = "empty";
 
+// Appended to every TestName so each test run gets its own shared memory files
+std::string TestSuffix = "";
+
+/*
+* Name of a shared resource used by a test. Converts to the base name plus the
+* suffix of the currently running test, so tests running in parallel, or
+* repeated, never share /dev/shm files
+*/
+class TestName
+{
+private:
+	const char *_base;
+
+public:
+	constexpr TestName(const char *base) : _base(base) {}
+
+	operator const char*() const
+	{
+		static std::map<const char*, std::string> names;
+		auto &name = names[_base];
+		const std::string expected = _base + TestSuffix;
+		if (name != expected)
+			name = expected;
+		return name.c_str();
+	}
+};
 
 constexpr long          CHILD_SLEEP_TIME = 10 * 60 * 1000; /* 10 minutes */
-constexpr const char*   SHARE_NAME_1     = "SHARE_1";
-constexpr long          WAIT_TIME_1      = 500;  /* 500 ms */
-constexpr long          WAIT_TIME_2      = 750;  /* 750 ms */
+constexpr TestName      SHARE_NAME_1     = "SHARE_1";
+constexpr long          WAIT_TIME_1      = 100;  /* 100 ms, short timeout that is expected to expire */
+constexpr long          WAIT_TIME_2      = 2000; /* 2 s, generous timeout that is not expected to expire */
 constexpr unsigned int  TEST_COUNT_1     = 1234;
 constexpr long          TEST_TIMESTAMP   = 999999;
+constexpr long          TEST_TIMEOUT     = 30 * 1000; /* 30 seconds per test */
 
 
 typedef void (*TEST_TYPE)();
 
+struct TestCase {
+	const char *name;
+	TEST_TYPE   test;
+};
+
+#define TEST_CASE(test) TestCase { #test, &test }
+
 static void logtest(const char *testname)
 {
 	std::cout << "Running: " << testname << std::endl;
@@ -70,4 +117,269 @@ static void compare(const T &expected, const T &actual, const std::string &messa
 
 static void SleepFor(const long milliseconds) {
 	std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
-}
\ No newline at end of file
+}
+
+//====================================================================================================
+// Forked children
+
+/*
+* Rendezvous between a test and the child it forks. Create it before fork()
+* and call Arrive() on both sides; neither side proceeds until the other
+* has arrived. Arrive() returns false if the other process died or the
+* wait timed out, so a broken test cannot hang the run
+*/
+class TestBarrier
+{
+private:
+	int  _toChild[2];
+	int  _toParent[2];
+	bool _isChild;
+
+public:
+	TestBarrier() : _isChild(false)
+	{
+		(void)! pipe(_toChild);
+		(void)! pipe(_toParent);
+	}
+
+	virtual ~TestBarrier()
+	{
+		for (auto fd : { _toChild[0], _toChild[1], _toParent[0], _toParent[1] })
+		{
+			if (fd != -1)
+				close(fd);
+		}
+	}
+
+	// Call on both sides right after fork()
+	void Forked(pid_t childPid)
+	{
+		_isChild = childPid == 0;
+		auto &unusedRead = _isChild ? _toParent[0] : _toChild[0];
+		auto &unusedWrite = _isChild ? _toChild[1] : _toParent[1];
+		close(unusedRead);
+		close(unusedWrite);
+		unusedRead = unusedWrite = -1;
+	}
+
+	bool Arrive(long timeout = TEST_TIMEOUT)
+	{
+		const int writeEnd = _isChild ? _toParent[1] : _toChild[1];
+		const int readEnd = _isChild ? _toChild[0] : _toParent[0];
+
+		char token = 1;
+		if (write(writeEnd, &token, 1) != 1)
+			return false;
+
+		struct pollfd fd = { readEnd, POLLIN, 0 };
+		if (poll(&fd, 1, (int)timeout) != 1)
+			return false;
+		return read(readEnd, &token, 1) == 1;
+	}
+};
+
+// Ends a forked child without running the rest of the test or any destructors
+[[noreturn]] static void ExitChild()
+{
+	std::cout.flush();
+	std::cerr.flush();
+	_exit(0);
+}
+
+// Stops a forked child and reaps it so no zombie is left behind
+static void StopChild(pid_t childPid)
+{
+	kill(childPid, SIGKILL);
+	waitpid(childPid, nullptr, 0);
+}
+
+//====================================================================================================
+// Runner
+
+struct TestOptions {
+	unsigned int jobs    = 1;             // Tests running at once
+	unsigned int repeat  = 1;             // Times every test is run
+	long         timeout = TEST_TIMEOUT;  // Per test, milliseconds
+	std::string  filter  = "";            // Only run tests containing this
+};
+
+/*
+* Deletes every /dev/shm file created for the given test suffix.
+* Returns the number of files deleted
+*/
+static unsigned int RemoveTestFiles(const std::string &suffix)
+{
+	unsigned int count = 0;
+	auto directory = opendir("/dev/shm");
+	if (directory == nullptr)
+		return count;
+
+	while (auto entry = readdir(directory))
+	{
+		// The suffix ends the name, or a per-process part like ".<pid>" follows it
+		const std::string name = entry->d_name;
+		const auto position = name.find(suffix);
+		const auto end = position + suffix.size();
+		if (position != std::string::npos && position > 0 && (end == name.size() || name[end] == '.'))
+		{
+			if (shm_unlink(name.c_str()) == 0)
+				++count;
+		}
+	}
+	closedir(directory);
+	return count;
+}
+
+/*
+* - Runs every test in its own worker process, up to options.jobs at once
+* - Each worker gets a unique TestSuffix, so tests never share /dev/shm files,
+*   and the files are deleted once the worker finishes
+* - A worker is killed, with its whole process group, when it exceeds
+*   options.timeout
+* - Worker output is collected and printed as one block per test
+* - Orphaned grandchildren are reaped as the runner is their subreaper
+* Returns the number of failed tests
+*/
+static unsigned int RunTests(const std::vector<TestCase> &tests, const TestOptions &options)
+{
+	struct Worker {
+		std::string name;
+		std::string suffix;
+		std::string output;
+		int         outputFd;
+		std::chrono::steady_clock::time_point deadline;
+		bool        timedOut;
+	};
+
+	prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+	std::vector<const TestCase*> pending;
+	for (unsigned int run = 0; run < options.repeat; ++run)
+	{
+		for (auto &test : tests)
+		{
+			if (options.filter.empty() || std::string(test.name).find(options.filter) != std::string::npos)
+				pending.push_back(&test);
+		}
+	}
+
+	static unsigned int testNumber = 0;
+	std::map<pid_t, Worker> running;
+	unsigned int failcount = 0;
+	unsigned int total = (unsigned int) pending.size();
+	size_t next = 0;
+
+	auto drain = [](Worker &worker) {
+		char buffer[4096];
+		ssize_t count;
+		while ((count = read(worker.outputFd, buffer, sizeof(buffer))) > 0)
+			worker.output.append(buffer, count);
+	};
+
+	while (next < pending.size() || !running.empty())
+	{
+		// Start workers
+		while (next < pending.size() && running.size() < options.jobs)
+		{
+			auto test = pending[next++];
+			Worker worker;
+			worker.name = test->name;
+			worker.suffix = "_T" + std::to_string(getpid()) + "_" + std::to_string(++testNumber);
+			worker.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.timeout);
+			worker.timedOut = false;
+
+			int output[2];
+			if (pipe(output) != 0)
+			{
+				std::cerr << "Could not create pipe for " << worker.name << std::endl;
+				++failcount;
+				continue;
+			}
+
+			std::cout.flush();
+			std::cerr.flush();
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				setpgid(0, 0);
+				close(output[0]);
+				dup2(output[1], STDOUT_FILENO);
+				dup2(output[1], STDERR_FILENO);
+				close(output[1]);
+
+				TestSuffix = worker.suffix;
+				const bool passed = runtest(test->test);
+				std::cout.flush();
+				std::cerr.flush();
+				_exit(passed ? 0 : 1);
+			}
+
+			close(output[1]);
+			if (pid < 0)
+			{
+				close(output[0]);
+				std::cerr << "Could not fork worker for " << worker.name << std::endl;
+				++failcount;
+				continue;
+			}
+			setpgid(pid, pid);
+			fcntl(output[0], F_SETFL, O_NONBLOCK);
+			worker.outputFd = output[0];
+			running[pid] = worker;
+		}
+
+		// Collect output, a full pipe would block the worker
+		std::vector<struct pollfd> fds;
+		for (auto &entry : running)
+			fds.push_back({ entry.second.outputFd, POLLIN, 0 });
+		poll(fds.data(), fds.size(), 10);
+		for (auto &entry : running)
+			drain(entry.second);
+
+		// Kill workers past their deadline
+		const auto now = std::chrono::steady_clock::now();
+		for (auto &entry : running)
+		{
+			if (!entry.second.timedOut && now > entry.second.deadline)
+			{
+				entry.second.timedOut = true;
+				kill(-entry.first, SIGKILL);
+			}
+		}
+
+		// Reap finished workers and any orphaned grandchildren
+		int status;
+		pid_t pid;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		{
+			auto found = running.find(pid);
+			if (found == running.end())
+				continue;
+
+			auto &worker = found->second;
+			kill(-pid, SIGKILL); // Children forked by the test that are still around
+			drain(worker);
+			close(worker.outputFd);
+			RemoveTestFiles(worker.suffix);
+
+			const bool passed = !worker.timedOut && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+			std::cout << worker.output;
+			if (worker.timedOut)
+				handle_error("Timeout after " + std::to_string(options.timeout) + " ms: " + worker.name);
+			else if (!passed && WIFSIGNALED(status))
+				handle_error("Crashed with signal " + std::to_string(WTERMSIG(status)) + ": " + worker.name);
+			std::cout.flush();
+
+			if (!passed)
+				++failcount;
+			running.erase(found);
+		}
+	}
+
+	if (failcount == 0)
+		std::cout << "All " << total << " tests passed" << std::endl;
+	else
+		std::cerr << "Error: " << failcount << " tests out of " << total << " failed!" << std::endl;
+
+	return failcount;
+}
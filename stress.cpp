@@ -0,0 +1,522 @@
+/*
+* Crash-injection stress harness for LinuxSharedMutex.
+*
+* - Forks many worker processes that open every named mutex of a small set
+*   once, then repeatedly TryLock() a random one, spend a short time in the
+*   critical section and unlock it again. With --reopen the mutex is opened
+*   and released around every acquisition instead
+* - A coordinator SIGKILLs random holders in the middle of their critical
+*   section and forks replacements, keeping the process count constant
+* - Mutual exclusion is checked with per-lock invariant counters kept in an
+*   anonymous shared mapping that is independent of the library
+* - Reports acquire latency percentiles, time from a holder being killed to
+*   the next successful acquisition of the same name (time-to-recovery),
+*   kills not recovered by the end of the run and /dev/shm regions left
+*   behind, as JSON. The exit code is non-zero if mutual exclusion was broken
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "SharedMutex.hpp"
+
+constexpr unsigned int MAX_LOCKS           = 1024;
+constexpr unsigned int MAX_RECOVERIES      = 65536;
+constexpr unsigned int HISTOGRAM_BUCKETS   = 512;
+constexpr unsigned int HISTOGRAM_SUB_BITS  = 3;     /* 8 buckets per power of two, ~12% resolution */
+
+struct StressOptions {
+	unsigned int processes       = 200;
+	unsigned int locks           = 16;
+	long         duration        = 10 * 1000;   // ms
+	long         killInterval    = 100;         // ms between kills, 0 disables killing
+	long         holdTime        = 50;          // us spent in the critical section
+	int          lockTimeout     = 100;         // ms passed to TryLock()
+	unsigned int seed            = 0;
+	std::string  prefix          = "IPC_STRESS";
+	std::string  output          = "";          // JSON file, stdout if empty
+	bool         keepLeaks       = false;
+	bool         reopen          = false;       // Open and release the mutex around every acquisition
+};
+
+/*
+* Per-lock invariant state, written only by the process inside the critical
+* section, except killed/killedAt, which the coordinator sets before a kill
+*/
+struct stress_lock_state {
+	std::atomic<pid_t> owner;      // Process inside the critical section, 0 if none
+	std::atomic<int>   inside;     // Processes inside the critical section, must be 0 or 1
+	std::atomic<pid_t> killed;     // Holder killed inside the critical section, 0 if none
+	std::atomic<long>  killedAt;   // CLOCK_MONOTONIC ns of the kill
+};
+
+/*
+* Mapped MAP_SHARED | MAP_ANONYMOUS before forking, so every worker sees it.
+*/
+struct stress_shared {
+	std::atomic<bool>          stop;
+	std::atomic<long>          acquisitions;
+	std::atomic<long>          timeouts;
+	std::atomic<long>          violations;
+	std::atomic<long>          recoveries;
+	std::atomic<long>          latency[HISTOGRAM_BUCKETS];      // Acquire latency histogram, ns
+	std::atomic<long>          maxLatency;
+	std::atomic<unsigned long> recoveryCount;
+	long                       recovery[MAX_RECOVERIES];        // Time-to-recovery samples, ns
+	stress_lock_state          locks[MAX_LOCKS];
+};
+
+static long MonotonicNanoseconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+//====================================================================================================
+// Log-linear histogram
+
+static unsigned int BucketOf(long value)
+{
+	constexpr long linear = 1L << (HISTOGRAM_SUB_BITS + 1);
+	if (value < linear)
+		return (unsigned int) std::max(0L, value);
+
+	const int exponent = 63 - __builtin_clzl((unsigned long) value);
+	const long sub = (value >> (exponent - HISTOGRAM_SUB_BITS)) & ((1L << HISTOGRAM_SUB_BITS) - 1);
+	const long bucket = linear + (exponent - HISTOGRAM_SUB_BITS - 1) * (1L << HISTOGRAM_SUB_BITS) + sub;
+	return (unsigned int) std::min<long>(bucket, HISTOGRAM_BUCKETS - 1);
+}
+
+// Upper bound of the values counted in a bucket
+static long BucketLimit(unsigned int bucket)
+{
+	constexpr long linear = 1L << (HISTOGRAM_SUB_BITS + 1);
+	if (bucket < linear)
+		return bucket;
+
+	const long index = bucket - linear;
+	const long exponent = index / (1L << HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS + 1;
+	const long sub = index % (1L << HISTOGRAM_SUB_BITS);
+	if (exponent >= 62)
+		return std::numeric_limits<long>::max();
+	return (1L << exponent) + ((sub + 1) << (exponent - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+static long HistogramPercentile(const std::atomic<long> *histogram, double percentile)
+{
+	long total = 0;
+	for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+		total += histogram[i].load();
+	if (total == 0)
+		return 0;
+
+	const long rank = (long) (percentile / 100.0 * (total - 1)) + 1;
+	long seen = 0;
+	for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+	{
+		seen += histogram[i].load();
+		if (seen >= rank)
+			return BucketLimit(i);
+	}
+	return BucketLimit(HISTOGRAM_BUCKETS - 1);
+}
+
+static long SamplePercentile(std::vector<long> samples, double percentile)
+{
+	if (samples.empty())
+		return 0;
+	std::sort(samples.begin(), samples.end());
+	const size_t rank = (size_t) (percentile / 100.0 * (samples.size() - 1));
+	return samples[rank];
+}
+
+//====================================================================================================
+// Worker
+
+static std::string LockName(const StressOptions &options, unsigned int index)
+{
+	return options.prefix + "_" + std::to_string(index);
+}
+
+static void RecordLatency(stress_shared &shared, long latency)
+{
+	shared.latency[BucketOf(latency)].fetch_add(1, std::memory_order_relaxed);
+	long maxLatency = shared.maxLatency.load(std::memory_order_relaxed);
+	while (latency > maxLatency && !shared.maxLatency.compare_exchange_weak(maxLatency, latency))
+		;
+}
+
+static void BusyWait(long microseconds)
+{
+	const long until = MonotonicNanoseconds() + microseconds * 1000;
+	while (MonotonicNanoseconds() < until)
+		;
+}
+
+[[noreturn]] static void RunWorker(stress_shared &shared, const StressOptions &options, unsigned int seed)
+{
+	std::mt19937 random(seed);
+	const pid_t pid = getpid();
+
+	// Opened once, so the run measures recovery from killed holders and not region churn
+	std::vector<std::unique_ptr<LinuxSharedMutex>> mutexes(options.locks);
+	if (!options.reopen)
+	{
+		for (unsigned int index = 0; index < options.locks; ++index)
+			mutexes[index].reset(new LinuxSharedMutex(LockName(options, index).c_str()));
+	}
+
+	while (!shared.stop.load(std::memory_order_relaxed))
+	{
+		const unsigned int index = random() % options.locks;
+		auto &state = shared.locks[index];
+
+		const long start = MonotonicNanoseconds();
+		std::unique_ptr<LinuxSharedMutex> reopened;
+		if (options.reopen)
+			reopened.reset(new LinuxSharedMutex(LockName(options, index).c_str()));
+		auto &mutex = options.reopen ? *reopened : *mutexes[index];
+		const bool locked = mutex.TryLock(options.lockTimeout);
+		const long acquired = MonotonicNanoseconds();
+
+		// Timed out attempts count with the time they waited, so the tail is not cut off
+		RecordLatency(shared, acquired - start);
+		if (!locked)
+		{
+			shared.timeouts.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+		shared.acquisitions.fetch_add(1, std::memory_order_relaxed);
+
+		// A previous owner still recorded means it never left the critical section
+		const pid_t previous = state.owner.exchange(pid, std::memory_order_acq_rel);
+		if (previous != 0)
+		{
+			if (previous == state.killed.load(std::memory_order_acquire))
+			{
+				const long recovery = acquired - state.killedAt.load(std::memory_order_acquire);
+				const auto slot = shared.recoveryCount.fetch_add(1, std::memory_order_relaxed);
+				if (slot < MAX_RECOVERIES)
+					shared.recovery[slot] = recovery;
+				shared.recoveries.fetch_add(1, std::memory_order_relaxed);
+				state.killed.store(0, std::memory_order_release);
+				state.inside.store(0, std::memory_order_release);
+			}
+			else
+				shared.violations.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		if (state.inside.fetch_add(1, std::memory_order_acq_rel) != 0)
+			shared.violations.fetch_add(1, std::memory_order_relaxed);
+
+		BusyWait(options.holdTime);
+
+		state.inside.fetch_sub(1, std::memory_order_acq_rel);
+		pid_t self = pid;
+		state.owner.compare_exchange_strong(self, 0, std::memory_order_acq_rel);
+		mutex.Unlock();
+	}
+
+	// _exit() skips the destructors
+	mutexes.clear();
+	std::cout.flush();
+	_exit(0);
+}
+
+//====================================================================================================
+// Coordinator
+
+static pid_t SpawnWorker(stress_shared &shared, const StressOptions &options, std::mt19937 &random)
+{
+	const unsigned int seed = random();
+	pid_t pid = fork();
+	if (pid == 0)
+		RunWorker(shared, options, seed);
+	return pid;
+}
+
+static std::vector<std::string> FindRegions(const std::string &prefix)
+{
+	std::vector<std::string> names;
+	auto directory = opendir("/dev/shm");
+	if (directory == nullptr)
+		return names;
+	while (auto entry = readdir(directory))
+	{
+		const std::string name = entry->d_name;
+		if (name.compare(0, prefix.size(), prefix) == 0)
+			names.push_back(name);
+	}
+	closedir(directory);
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+static void Usage(const char *program)
+{
+	std::cout
+		<< "Usage: " << program << " [options]" << std::endl
+		<< "  --processes N         Worker processes kept alive (default 200)" << std::endl
+		<< "  --locks N             Distinct mutex names (default 16, max " << MAX_LOCKS << ")" << std::endl
+		<< "  --duration MS         Length of the run (default 10000)" << std::endl
+		<< "  --kill-interval MS    Time between SIGKILLs of a holder, 0 disables (default 100)" << std::endl
+		<< "  --hold US             Time spent inside the critical section (default 50)" << std::endl
+		<< "  --lock-timeout MS     Timeout passed to TryLock (default 100)" << std::endl
+		<< "  --seed N              Random seed (default: time based)" << std::endl
+		<< "  --prefix NAME         Prefix of the mutex names (default IPC_STRESS)" << std::endl
+		<< "  --output FILE         Write the JSON report here instead of stdout" << std::endl
+		<< "  --keep-leaks          Do not delete leaked /dev/shm regions" << std::endl
+		<< "  --reopen              Open and release the mutex around every acquisition" << std::endl;
+}
+
+static bool ParseOptions(int argc, char **argv, StressOptions &options)
+{
+	static const struct option longOptions[] = {
+		{ "processes",        required_argument, nullptr, 'p' },
+		{ "locks",            required_argument, nullptr, 'l' },
+		{ "duration",         required_argument, nullptr, 'd' },
+		{ "kill-interval",    required_argument, nullptr, 'k' },
+		{ "hold",             required_argument, nullptr, 'h' },
+		{ "lock-timeout",     required_argument, nullptr, 't' },
+		{ "seed",             required_argument, nullptr, 's' },
+		{ "prefix",           required_argument, nullptr, 'x' },
+		{ "output",           required_argument, nullptr, 'o' },
+		{ "keep-leaks",       no_argument,       nullptr, 'K' },
+		{ "reopen",           no_argument,       nullptr, 'r' },
+		{ "help",             no_argument,       nullptr, '?' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+
+	options.seed = (unsigned int) std::chrono::steady_clock::now().time_since_epoch().count();
+
+	int option;
+	while ((option = getopt_long(argc, argv, "", longOptions, nullptr)) != -1)
+	{
+		switch (option)
+		{
+		case 'p': options.processes = (unsigned int) std::max(1, atoi(optarg)); break;
+		case 'l': options.locks = (unsigned int) std::min<int>(MAX_LOCKS, std::max(1, atoi(optarg))); break;
+		case 'd': options.duration = std::max(1L, atol(optarg)); break;
+		case 'k': options.killInterval = std::max(0L, atol(optarg)); break;
+		case 'h': options.holdTime = std::max(0L, atol(optarg)); break;
+		case 't': options.lockTimeout = std::max(0, atoi(optarg)); break;
+		case 's': options.seed = (unsigned int) strtoul(optarg, nullptr, 10); break;
+		case 'x': options.prefix = optarg; break;
+		case 'o': options.output = optarg; break;
+		case 'K': options.keepLeaks = true; break;
+		case 'r': options.reopen = true; break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	StressOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		Usage(argv[0]);
+		return 2;
+	}
+
+	auto leftovers = FindRegions(options.prefix);
+	if (!leftovers.empty())
+	{
+		std::cerr << "Regions with prefix " << options.prefix << " already exist in /dev/shm, delete them first" << std::endl;
+		return 2;
+	}
+
+	auto shared = (stress_shared*) mmap(nullptr, sizeof(stress_shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED)
+	{
+		std::cerr << "Could not map shared state" << std::endl;
+		return 2;
+	}
+
+	std::mt19937 random(options.seed);
+	std::set<pid_t> workers;
+	for (unsigned int i = 0; i < options.processes; ++i)
+	{
+		pid_t pid = SpawnWorker(*shared, options, random);
+		if (pid > 0)
+			workers.insert(pid);
+	}
+
+	long kills = 0;
+	long killsInCriticalSection = 0;
+	long spawnFailures = 0;
+	const long start = MonotonicNanoseconds();
+	const long end = start + options.duration * 1000000L;
+	long nextKill = start + options.killInterval * 1000000L;
+
+	while (MonotonicNanoseconds() < end)
+	{
+		usleep(1000);
+
+		if (options.killInterval > 0 && MonotonicNanoseconds() >= nextKill)
+		{
+			nextKill += options.killInterval * 1000000L;
+
+			// Pick a lock that is held right now and kill its holder
+			const unsigned int first = random() % options.locks;
+			for (unsigned int i = 0; i < options.locks; ++i)
+			{
+				auto &state = shared->locks[(first + i) % options.locks];
+				const pid_t victim = state.owner.load(std::memory_order_acquire);
+				if (victim == 0 || workers.count(victim) == 0 || state.killed.load() != 0)
+					continue;
+
+				state.killedAt.store(MonotonicNanoseconds(), std::memory_order_release);
+				state.killed.store(victim, std::memory_order_release);
+				kill(victim, SIGKILL);
+				waitpid(victim, nullptr, 0);
+				workers.erase(victim);
+				++kills;
+
+				// The holder may have left the critical section before the signal landed
+				if (state.owner.load(std::memory_order_acquire) == victim)
+					++killsInCriticalSection;
+				else
+				{
+					pid_t expected = victim;
+					state.killed.compare_exchange_strong(expected, 0);
+				}
+				break;
+			}
+		}
+
+		// Reap workers that exited on their own and keep the count constant
+		int status;
+		pid_t pid;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+			workers.erase(pid);
+		while (workers.size() < options.processes)
+		{
+			pid = SpawnWorker(*shared, options, random);
+			if (pid <= 0)
+			{
+				++spawnFailures;
+				break;
+			}
+			workers.insert(pid);
+		}
+	}
+
+	// Give workers one lock timeout to finish, then kill stragglers
+	shared->stop = true;
+	const long grace = MonotonicNanoseconds() + (options.lockTimeout + 1000) * 1000000L;
+	while (!workers.empty() && MonotonicNanoseconds() < grace)
+	{
+		pid_t pid = waitpid(-1, nullptr, WNOHANG);
+		if (pid > 0)
+			workers.erase(pid);
+		else
+			usleep(1000);
+	}
+	const long stragglers = (long) workers.size();
+	for (auto pid : workers)
+	{
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+	}
+	const long elapsed = MonotonicNanoseconds() - start;
+
+	// Kills no other process recovered from before the end of the run
+	long unrecovered = 0;
+	for (unsigned int i = 0; i < options.locks; ++i)
+	{
+		if (shared->locks[i].killed.load() != 0)
+			++unrecovered;
+	}
+
+	std::vector<long> recoveries(shared->recovery, shared->recovery + std::min<unsigned long>(shared->recoveryCount, MAX_RECOVERIES));
+	auto leaked = FindRegions(options.prefix);
+	if (!options.keepLeaks)
+	{
+		for (auto &name : leaked)
+			shm_unlink(name.c_str());
+	}
+
+	std::ostringstream report;
+	report
+		<< "{" << std::endl
+		<< "  \"processes\": " << options.processes << "," << std::endl
+		<< "  \"locks\": " << options.locks << "," << std::endl
+		<< "  \"duration_ms\": " << elapsed / 1000000L << "," << std::endl
+		<< "  \"kill_interval_ms\": " << options.killInterval << "," << std::endl
+		<< "  \"hold_us\": " << options.holdTime << "," << std::endl
+		<< "  \"lock_timeout_ms\": " << options.lockTimeout << "," << std::endl
+		<< "  \"reopen\": " << (options.reopen ? "true" : "false") << "," << std::endl
+		<< "  \"seed\": " << options.seed << "," << std::endl
+		<< "  \"acquisitions\": " << shared->acquisitions << "," << std::endl
+		<< "  \"timeouts\": " << shared->timeouts << "," << std::endl
+		<< "  \"violations\": " << shared->violations << "," << std::endl
+		<< "  \"kills\": " << kills << "," << std::endl
+		<< "  \"kills_in_critical_section\": " << killsInCriticalSection << "," << std::endl
+		<< "  \"recoveries\": " << shared->recoveries << "," << std::endl
+		<< "  \"unrecovered\": " << unrecovered << "," << std::endl
+		<< "  \"spawn_failures\": " << spawnFailures << "," << std::endl
+		<< "  \"stragglers\": " << stragglers << "," << std::endl
+		<< "  \"acquire_latency_ns\": {"
+		<< " \"p50\": " << HistogramPercentile(shared->latency, 50)
+		<< ", \"p90\": " << HistogramPercentile(shared->latency, 90)
+		<< ", \"p99\": " << HistogramPercentile(shared->latency, 99)
+		<< ", \"p999\": " << HistogramPercentile(shared->latency, 99.9)
+		<< ", \"max\": " << shared->maxLatency << " }," << std::endl
+		<< "  \"recovery_latency_ms\": ";
+	// null rather than zeros, no recovery is not an instant one
+	if (recoveries.empty())
+		report << "null," << std::endl;
+	else
+	{
+		report << "{"
+			<< " \"p50\": " << SamplePercentile(recoveries, 50) / 1e6
+			<< ", \"p99\": " << SamplePercentile(recoveries, 99) / 1e6
+			<< ", \"max\": " << SamplePercentile(recoveries, 100) / 1e6 << " }," << std::endl;
+	}
+	report << "  \"leaked_regions\": [";
+	for (size_t i = 0; i < leaked.size(); ++i)
+		report << (i == 0 ? " " : ", ") << "\"" << leaked[i] << "\"";
+	report << (leaked.empty() ? "" : " ") << "]" << std::endl << "}" << std::endl;
+
+	bool written = true;
+	if (options.output.empty())
+		std::cout << report.str();
+	else
+	{
+		std::ofstream file(options.output);
+		file << report.str();
+		file.close();
+		written = !file.fail();
+		if (!written)
+			std::cerr << "Could not write the report to " << options.output << std::endl;
+	}
+
+	const bool passed = shared->violations == 0;
+	munmap(shared, sizeof(stress_shared));
+	if (!written)
+		return 2;
+	return passed ? 0 : 1;
+}
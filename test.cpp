@@ -1,32 +1,66 @@
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
 #include "TestHelpers.h"
 #include "SharedRegionTests.h"
 #include "SharedMutexTests.h"
+#include "LockRegistryTests.h"
+#include "LockTraceTests.h"
+#include "SharedArenaTests.h"
+#include "SharedLockTableTests.h"
+#include "SharedUpgradableMutexTests.h"
+#include "SharedBarrierTests.h"
+#include "SharedSnapshotTests.h"
 
-void runAllTest(const std::vector<TEST_TYPE>& tests)
+static void usage(const char *program)
 {
-	unsigned int failcount = 0;
-	for (auto test : tests)
-	{
-		if (!runtest(test))
-			++failcount;
-	}
-
-	if (failcount == 0)
-		std::cout << "All " << tests.size() << " tests passed" << std::endl;
-	else
-		std::cerr << "Error: " << failcount << " tests out of " << tests.size() << " failed!" << std::endl;
+	std::cout
+		<< "Usage: " << program << " [-j jobs] [-r repeat] [-t timeout_ms] [filter]" << std::endl
+		<< "  -j  Number of tests running in parallel (default: number of cpus)" << std::endl
+		<< "  -r  Run every test this many times (default: 1)" << std::endl
+		<< "  -t  Per-test timeout in milliseconds (default: " << TEST_TIMEOUT << ")" << std::endl
+		<< "  filter  Only run tests whose name contains this" << std::endl;
 }
 
-
-int main(void)
+int main(int argc, char **argv)
 {
-	std::cout << divider1 << std::endl << "Starting Shared Region Tests ..." << std::endl;
-	auto sharedRegionTests = GetSharedRegionTests();
-	runAllTest(sharedRegionTests);
+	TestOptions options;
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	options.jobs = cpus > 0 ? (unsigned int) cpus : 1;
 
-	std::cout << divider1 << std::endl << "Starting Shared Mutex Tests ..." << std::endl;
-	auto sharedMutexTests = GetSharedMutexTests();
-	runAllTest(sharedMutexTests);
-	
-	return 0;
-}
\ No newline at end of file
+	int option;
+	while ((option = getopt(argc, argv, "j:r:t:h")) != -1)
+	{
+		switch (option)
+		{
+		case 'j': options.jobs = (unsigned int) std::max(1, atoi(optarg)); break;
+		case 'r': options.repeat = (unsigned int) std::max(1, atoi(optarg)); break;
+		case 't': options.timeout = std::max(1L, atol(optarg)); break;
+		default:
+			usage(argv[0]);
+			return option == 'h' ? 0 : 2;
+		}
+	}
+	if (optind < argc)
+		options.filter = argv[optind];
+
+	// One run over all groups, so tests of different groups run in parallel too
+	const std::vector<std::vector<TestCase>> groups = {
+		GetSharedRegionTests(),
+		GetSharedMutexTests(),
+		GetLockRegistryTests(),
+		GetLockTraceTests(),
+		GetSharedArenaTests(),
+		GetSharedLockTableTests(),
+		GetSharedUpgradableMutexTests(),
+		GetSharedBarrierTests(),
+		GetSharedSnapshotTests(),
+	};
+	std::vector<TestCase> tests;
+	for (auto &group : groups)
+		tests.insert(tests.end(), group.begin(), group.end());
+
+	std::cout << divider1 << std::endl << "Starting Tests ..." << std::endl;
+	const unsigned int failcount = RunTests(tests, options);
+	return failcount == 0 ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+/*
+* Merges the lock trace segments of all processes into one Chrome/Perfetto
+* JSON timeline (load it in chrome://tracing or ui.perfetto.dev).
+*
+* - Waiting for a lock becomes a "wait <name>" slice, from acquire-start to
+*   acquired or timeout. A timeout is also marked with an instant event
+* - Holding a lock becomes a "hold <name>" slice, from acquired to release
+* - Slices are placed on the pid/tid that recorded them
+*/
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <getopt.h>
+#include "LockTrace.hpp"
+
+static void Usage(const char *program)
+{
+	std::cout
+		<< "Usage: " << program << " [--prefix NAME] [--output FILE] [--clear]" << std::endl
+		<< "  --prefix NAME  Prefix of the trace segments in /dev/shm (default " << LOCK_TRACE_PREFIX << ")" << std::endl
+		<< "  --output FILE  Write the JSON here instead of stdout" << std::endl
+		<< "  --clear        Delete the trace segments after exporting them" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option longOptions[] = {
+		{ "prefix", required_argument, nullptr, 'p' },
+		{ "output", required_argument, nullptr, 'o' },
+		{ "clear",  no_argument,       nullptr, 'c' },
+		{ "help",   no_argument,       nullptr, '?' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+
+	std::string prefix = LOCK_TRACE_PREFIX;
+	std::string output = "";
+	bool clear = false;
+
+	int option;
+	while ((option = getopt_long(argc, argv, "", longOptions, nullptr)) != -1)
+	{
+		switch (option)
+		{
+		case 'p': prefix = optarg; break;
+		case 'o': output = optarg; break;
+		case 'c': clear = true; break;
+		default:
+			Usage(argv[0]);
+			return 2;
+		}
+	}
+
+	std::vector<std::string> segments;
+	auto records = ReadLockTraces(prefix, &segments);
+
+	const std::string json = ExportLockTraces(records);
+	if (output.empty())
+		std::cout << json;
+	else
+		std::ofstream(output) << json;
+
+	std::cerr << "Exported " << records.size() << " events from " << segments.size() << " processes" << std::endl;
+
+	if (clear)
+		DeleteLockTraces(segments);
+	return 0;
+}